@@ -1,18 +1,129 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+/* output is collected in one large buffer and written with write(2),
+   input is read from fd 0 in bulk and parsed by hand, so no call goes
+   through printf/scanf format parsing or stdio locking */
 
-#include <stdio.h>
+#define OUT_SIZE (1 << 16)
+#define IN_SIZE  (1 << 16)
+
+static char out_buf[OUT_SIZE];
+static size_t out_len = 0;
+
+static char in_buf[IN_SIZE];
+static size_t in_pos = 0;
+static size_t in_len = 0;
+
+static void write_all(const char *p, size_t n) {
+  while (n > 0) {
+    ssize_t w = write(STDOUT_FILENO, p, n);
+    if (w <= 0) {
+      return;
+    }
+    p += w;
+    n -= w;
+  }
+}
+
+/* write out everything buffered so far, also called by the JIT driver */
+void decaf_flush(void) {
+  write_all(out_buf, out_len);
+  out_len = 0;
+}
+
+/* the buffer is flushed at exit however the program ends up there */
+__attribute__((constructor)) static void decaf_init(void) {
+  atexit(decaf_flush);
+}
+
+static void out_bytes(const char *p, size_t n) {
+  if (out_len + n > OUT_SIZE) {
+    decaf_flush();
+    if (n > OUT_SIZE) {
+      write_all(p, n);
+      return;
+    }
+  }
+  memcpy(out_buf + out_len, p, n);
+  out_len += n;
+}
 
 void print_int(int x) {
-  printf("%d", x);
+  char tmp[12];
+  char *p = tmp + sizeof(tmp);
+  /* work on the magnitude as unsigned so INT_MIN does not overflow */
+  unsigned int u = x < 0 ? 0u - (unsigned int)x : (unsigned int)x;
+  do {
+    *--p = '0' + u % 10;
+    u /= 10;
+  } while (u != 0);
+  if (x < 0) {
+    *--p = '-';
+  }
+  out_bytes(p, tmp + sizeof(tmp) - p);
 }
 
 void print_string(const char *s) {
-  printf("%s", s);
+  out_bytes(s, strlen(s));
+}
+
+/* next input byte or -1 at end of input */
+static int in_byte(void) {
+  if (in_pos == in_len) {
+    ssize_t r;
+    /* a prompt printed before the read has to be visible */
+    decaf_flush();
+    r = read(STDIN_FILENO, in_buf, IN_SIZE);
+    if (r <= 0) {
+      return -1;
+    }
+    in_pos = 0;
+    in_len = r;
+  }
+  return (unsigned char)in_buf[in_pos++];
 }
 
+/* like scanf("%d"): skip white space, optional sign, decimal digits;
+   returns 0 when no number could be read */
 int read_int() {
+  int c;
+  int neg = 0;
+  unsigned int u = 0;
+  do {
+    c = in_byte();
+  } while (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f');
+  if (c == '-' || c == '+') {
+    neg = (c == '-');
+    c = in_byte();
+  }
+  while (c >= '0' && c <= '9') {
+    u = u * 10 + (c - '0');
+    c = in_byte();
+  }
+  /* leave the byte that ended the number for the next read */
+  if (c != -1) {
+    in_pos--;
+  }
+  return neg ? (int)(0u - u) : (int)u;
+}
+
+/* bulk versions for whole arrays, one extern call instead of n */
+void read_int_array(int *a, int n) {
   int i;
-  scanf("%d", &i);
-  return i;
+  for (i = 0; i < n; i++) {
+    a[i] = read_int();
+  }
 }
 
+void print_int_array(const int *a, int n, const char *sep) {
+  int i;
+  size_t seplen = strlen(sep);
+  for (i = 0; i < n; i++) {
+    if (i > 0) {
+      out_bytes(sep, seplen);
+    }
+    print_int(a[i]);
+  }
+}
@@ -8,45 +8,294 @@
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/Config/llvm-config.h"
 #include <cstdio> 
 #include <cstdlib>
 #include <cstring> 
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+#include <algorithm>
 #include <string>
 #include <stdexcept>
 #include <vector>
 #include <list>
 #include <deque>
-
-extern int lineno;
-extern int tokenpos;
+#include <new>
+#include <set>
+#include <climits>
+#include <chrono>
+#include <ctime>
+#include <sstream>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 
+// decaf runtime (decaf-stdlib.c), linked into decafcomp for --run
 extern "C"
 {
-	extern int yyerror(const char *);
-	int yyparse(void);
-	int yylex(void);  
-	int yywrap(void);
+  void print_int(int);
+  void print_string(const char *);
+  int read_int(void);
+  void read_int_array(int *, int);
+  void print_int_array(const int *, int, const char *);
+  void decaf_flush(void);
 }
 
+// operators, carried from the lexer to BinaryExprAST and UnaryExprAST
+typedef enum
+{
+  OP_PLUS, OP_MINUS, OP_MULT, OP_DIV, OP_LEFTSHIFT, OP_RIGHTSHIFT, OP_MOD,
+  OP_EQ, OP_NEQ, OP_LT, OP_LEQ, OP_GT, OP_GEQ, OP_AND, OP_OR,
+  OP_NOT, OP_UNARYMINUS
+} decaf_op;
+
+// decaf types; TY_NONE marks an empty extern parameter list and
+// TY_INTARRAY ([]int) is only valid as an extern parameter
+typedef enum
+{
+  TY_NONE, TY_INT, TY_BOOL, TY_VOID, TY_STRING, TY_INTARRAY
+} decaf_type;
+
+// inline/noinline annotation of a method
+typedef enum
+{
+  INLINE_DEFAULT, INLINE_ALWAYS, INLINE_NEVER
+} inline_hint;
+
 typedef struct 
 { 
-  std::string* type;
-  std::string* size;
+  decaf_type type;
+  int size;            // id of the size literal in parse_context::literals
 }array_info;
 
-typedef map<string, llvm::Value*> symbol_table;
+// string_pool - interns identifiers: every distinct name gets a small
+// integer id and one stable copy of its text. The ids live in an open
+// addressing table, so looking up a name that is already interned
+// allocates nothing.
+class string_pool
+{
+  vector<string*> names;        // id -> text
+  vector<unsigned int> hashes;  // id -> hash of the text
+  vector<int> slots;            // open addressing table of ids, -1 when empty
+
+  static unsigned int hash(const char *s, size_t len);
+  int find(const char *s, size_t len, unsigned int h, size_t &slot) const;
+  void grow();
+
+public:
+  string_pool();
+  ~string_pool();
+
+  int intern(const char *s, size_t len);
+  int intern(const string &s) { return intern(s.data(), s.size()); }
+  // id of an interned name or -1, never inserts
+  int lookup(const string &s) const;
+  const string &name(int id) const { return *names[id]; }
+  int size() const { return (int)names.size(); }
+  // forget every name but the labels interned on construction
+  void clear();
+};
+
+class ProgramAST;
+
+// parse_context - the state of one parse. The scanner is reentrant and
+// the parser pure, so everything they share lives here instead of in
+// globals and any number of parses can run at once.
+struct parse_context
+{
+  void *scanner;              // the flex scanner (yyscan_t)
+  int lineno;
+  int tokenpos;
+  unsigned long tokencount;   // tokens returned to the parser, for --time-report
+  ProgramAST *program;        // the parsed program, NULL on a syntax error
+  string_pool literals;       // text of the literals, apart from the identifiers
+
+  parse_context() : scanner(NULL), lineno(1), tokenpos(1), tokencount(0), program(NULL) {}
+};
+
+// parse the program read from in; returns 0 on success like yyparse
+int parseProgram(parse_context &ctx, FILE *in);
+
+// symbol_table - scoped bindings from interned ids to values. Bindings
+// are kept on one stack and visible[id] points at the innermost binding
+// of id, so a lookup is one array access, pushing a scope is O(1) and
+// popping one only touches the bindings it made.
+class symbol_table
+{
+  typedef struct
+  {
+    int id;             // -1 once erased
+    llvm::Value *value;
+    int shadowed;       // binding of the same id this one hides, or -1
+  } binding;
+
+  vector<binding> bindings;
+  vector<int> visible;    // id -> index into bindings, -1 when unbound
+  vector<size_t> scopes;  // start of each open scope in bindings
+
+public:
+  void push_scope() { scopes.push_back(bindings.size()); }
+  void pop_scope();
+
+  // bind id in the innermost scope, replacing a binding already there
+  void insert(int id, llvm::Value *value);
+  // drop the innermost scope's binding of id, uncovering any outer one
+  void erase(int id);
+  // drop every scope and binding
+  void clear();
+
+  llvm::Value *lookup(int id) const
+  {
+    if(id < 0 || id >= (int)visible.size() || visible[id] < 0) { return NULL; }
+    return bindings[visible[id]].value;
+  }
+};
+
+// value of a local known to be constant during constant folding
+typedef struct
+{
+  decaf_type type;
+  int value;
+} fold_value;
+
+// constant locals by their name id in symnames
+typedef map<int, fold_value> fold_env;
+
+class decafAST;
+
+// ast_arena - bump allocator that owns every AST node of a compilation
+// and the elements of the lists they hold (see arena_allocator);
+// nodes are never deleted one by one, release() tears them all down
+class ast_arena
+{
+  static const size_t BLOCK_SIZE = 64 * 1024;
+
+  vector<char *> blocks;
+  char *cur;              // next free byte in the newest block
+  size_t left;            // bytes left in the newest block
+  vector<decafAST *> nodes; // constructed nodes, destroyed in reverse
+
+public:
+  ast_arena() : cur(NULL), left(0) {}
+  ~ast_arena() { release(); }
+
+  void *allocate(size_t n);
+  void track(decafAST *node) { nodes.push_back(node); }
+  size_t count() const { return nodes.size(); }
+  // run the node destructors and free all blocks
+  void release();
+};
+
+// phase_time - time spent in one compiler phase
+typedef struct
+{
+  string name;
+  double wall;   // seconds
+  double cpu;    // seconds of process cpu time
+} phase_time;
+
+// work_counter - an amount of work and the phase that did it, for the
+// throughput columns
+typedef struct
+{
+  string name;
+  unsigned long value;
+  string phase;
+} work_counter;
+
+// phase_clock - started on construction, stop() adds the elapsed time
+class phase_clock
+{
+  chrono::steady_clock::time_point wall0;
+  clock_t cpu0;
+
+public:
+  phase_clock() : wall0(chrono::steady_clock::now()), cpu0(clock()) {}
+  void stop(phase_time &phase) const;
+};
+
+// time_report - per phase wall/cpu time and work counters (--time-report)
+class time_report
+{
+  deque<phase_time> phases;   // phase() hands out references
+  vector<work_counter> counters;
+
+public:
+  // the named phase, added in first use order
+  phase_time &phase(const string &name);
+  void count(const string &name, unsigned long value, const string &phase);
+
+  // as IR comments, so the report can share stderr with the IR
+  void print_text(ostream &out);
+  void print_json(ostream &out);
+};
+
+extern thread_local string_pool symnames;
+
+extern thread_local symbol_table symtbl;
+
+extern thread_local ast_arena astArena;
+
+// arena_allocator - puts the elements of the statement lists in AST nodes
+// and of the parser's id lists in astArena too, so building a list costs
+// no heap allocation per element. deallocate is a no-op; the memory goes
+// when the arena is released.
+template <class T>
+struct arena_allocator
+{
+  typedef T value_type;
+
+  arena_allocator() {}
+  template <class U> arena_allocator(const arena_allocator<U> &) {}
+
+  T *allocate(size_t n) { return (T *)astArena.allocate(n * sizeof(T)); }
+  void deallocate(T *, size_t) {}
+};
 
-typedef list<symbol_table> symbol_table_list;
+template <class T, class U>
+bool operator==(const arena_allocator<T> &, const arena_allocator<U> &) { return true; }
+template <class T, class U>
+bool operator!=(const arena_allocator<T> &, const arena_allocator<U> &) { return false; }
 
-extern int lineno;
+// statements and declarations of a decafStmtList
+typedef list<decafAST *, arena_allocator<decafAST *> > ast_list;
 
-extern int tokenpos;
+// the name ids of a declaration like var a, b, c int; made with
+// new_id_list() and never deleted
+typedef deque<int, arena_allocator<int> > id_list;
 
-extern symbol_table_list symtbl;
+inline id_list *new_id_list() { return new (astArena.allocate(sizeof(id_list))) id_list(); }
 
-extern llvm::Value* access_symtbl(string id);
+extern thread_local time_report timeReport;
 
 #endif
 
@@ -13,115 +13,341 @@
 
 using namespace std;
 
-// empty list of symbol tables
-symbol_table_list symtbl;
+// interned identifiers and the scoped symbol table; like the rest of
+// the compiler state they are per thread so batch jobs run side by side
+thread_local string_pool symnames;
+thread_local symbol_table symtbl;
+
+// owner of all AST nodes
+thread_local ast_arena astArena;
+
+// phase times and counts for --time-report
+thread_local time_report timeReport;
+
+// ids of the basic blocks loops bind in the symbol table; every
+// string_pool interns these names first, so the ids are the same in
+// every thread
+static const char *label_names[] = { "0_looplatch", "0_loopend" };
+static const int LOOPLATCH_ID  = 0;
+static const int LOOPEND_ID    = 1;
+
+// alignment of global arrays in bytes
+static const unsigned int ARRAY_ALIGNMENT = 64;
+
+// alignment of method-local arrays in bytes, enough for vector loads
+static const unsigned int LOCAL_ARRAY_ALIGNMENT = 16;
+
+// largest method-local array in elements; local arrays share the stack
+// with every frame of a recursion, bigger ones have to be globals
+static const int MAX_LOCAL_ARRAY_SIZE = 4096;
+
+// -fbounds-check: value range [lo, hi] of local variables while the body
+// of a for loop over them is generated, keyed by their alloca
+static thread_local map<llvm::Value*, pair<int, int> > indexRanges;
+
+// -fbounds-check: the trap block each function's failed checks branch to
+static thread_local map<llvm::Function*, llvm::BasicBlock*> trapBlocks;
 
 // debug_flag
 bool debug_flag = false;
 
-// default return value
-llvm::Value* returnValue;
-
 void debug_print(bool flag, string output)
 {
   if(flag == true) { cout<<output<<endl;}
 }
 
-llvm::Value* access_symtbl(string id)
+string_pool::string_pool() : slots(64, -1)
+{
+  for(size_t i = 0; i < sizeof(label_names) / sizeof(label_names[0]); ++i)
+  {
+    intern(label_names[i], strlen(label_names[i]));
+  }
+}
+
+string_pool::~string_pool()
+{
+  for(size_t i = 0; i < names.size(); ++i)
+  {
+    delete names[i];
+  }
+}
+
+void string_pool::clear()
+{
+  for(size_t i = 0; i < names.size(); ++i)
+  {
+    delete names[i];
+  }
+  names.clear();
+  hashes.clear();
+  slots.assign(64, -1);
+  for(size_t i = 0; i < sizeof(label_names) / sizeof(label_names[0]); ++i)
+  {
+    intern(label_names[i], strlen(label_names[i]));
+  }
+}
+
+// FNV-1a
+unsigned int string_pool::hash(const char *s, size_t len)
+{
+  unsigned int h = 2166136261u;
+  for(size_t i = 0; i < len; ++i)
+  {
+    h = (h ^ (unsigned char)s[i]) * 16777619u;
+  }
+  return h;
+}
+
+// find - id of the name, or -1 with slot set to the empty slot it would take
+int string_pool::find(const char *s, size_t len, unsigned int h, size_t &slot) const
 {
-  for(symbol_table_list::iterator i = symtbl.begin(); i != symtbl.end(); ++i)
+  size_t mask = slots.size() - 1;
+  for(slot = h & mask; slots[slot] >= 0; slot = (slot + 1) & mask)
   {
-    symbol_table::iterator find_id;
-    if((find_id = i->find(id)) != i->end())
+    int id = slots[slot];
+    if(hashes[id] == h && names[id]->size() == len && memcmp(names[id]->data(), s, len) == 0)
     {
-      return find_id->second; // second refers to descriptor* in map<string, descriptor*> 
+      return id;
     }
-  } 
-  return NULL;
+  }
+  return -1;
+}
+
+void string_pool::grow()
+{
+  vector<int> old(slots.size() * 2, -1);
+  slots.swap(old);
+  size_t mask = slots.size() - 1;
+  for(int id = 0; id < (int)names.size(); ++id)
+  {
+    size_t slot = hashes[id] & mask;
+    while(slots[slot] >= 0) { slot = (slot + 1) & mask; }
+    slots[slot] = id;
+  }
+}
+
+int string_pool::intern(const char *s, size_t len)
+{
+  unsigned int h = hash(s, len);
+  size_t slot;
+  int id = find(s, len, h, slot);
+  if(id >= 0) { return id; }
+
+  id = (int)names.size();
+  names.push_back(new string(s, len));
+  hashes.push_back(h);
+  slots[slot] = id;
+
+  // keep the load factor at or below one half
+  if(names.size() * 2 > slots.size()) { grow(); }
+  return id;
+}
+
+int string_pool::lookup(const string &s) const
+{
+  size_t slot;
+  return find(s.data(), s.size(), hash(s.data(), s.size()), slot);
 }
 
-llvm::Value* access_current_scope(string id)
+void symbol_table::pop_scope()
 {
-  symbol_table i = symtbl.front();
-  symbol_table::iterator find_id;
-  if((find_id = i.find(id)) != i.end())
+  size_t start = scopes.back();
+  scopes.pop_back();
+  for(size_t i = bindings.size(); i > start; --i)
   {
-    return find_id->second; // second refers to descriptor* in map<string, descriptor*> 
+    binding &b = bindings[i - 1];
+    if(b.id >= 0) { visible[b.id] = b.shadowed; }
   }
-  return NULL;
+  bindings.resize(start);
 }
 
-void free_element(symbol_table table)
+void symbol_table::insert(int id, llvm::Value *value)
 {
-  for(symbol_table::iterator i = table.begin(); i != table.end(); ++i)
+  if(id >= (int)visible.size()) { visible.resize(id + 1, -1); }
+
+  int cur = visible[id];
+  if(cur >= 0 && (size_t)cur >= scopes.back())
   {
-    delete(i->second);
-  } 
-} 
+    bindings[cur].value = value;
+    return;
+  }
+
+  binding b = { id, value, cur };
+  visible[id] = (int)bindings.size();
+  bindings.push_back(b);
+}
+
+void symbol_table::clear()
+{
+  bindings.clear();
+  visible.clear();
+  scopes.clear();
+}
+
+void symbol_table::erase(int id)
+{
+  if(id < 0 || id >= (int)visible.size()) { return; }
+
+  int cur = visible[id];
+  if(cur >= 0 && (size_t)cur >= scopes.back())
+  {
+    visible[id] = bindings[cur].shadowed;
+    bindings[cur].id = -1;
+  }
+}
 
 int string_to_int(string str)
 {
-  int result;
-  stringstream ss;
-  if(str.find("x") != string::npos)
+  long long result = 0;
+  int base = 10;
+  size_t x = 0;
+  if(str.size() > 1 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
   {
-    ss<<hex<<str;
+    base = 16;
+    x = 2;
   }
-  else
+  for(; x < str.size(); ++x)
   {
-    ss<<str;  
+    int digit;
+    char c = str[x];
+    if(c >= '0' && c <= '9')      { digit = c - '0';      }
+    else if(c >= 'a' && c <= 'f') { digit = c - 'a' + 10; }
+    else if(c >= 'A' && c <= 'F') { digit = c - 'A' + 10; }
+    else break;
+
+    result = result * base + digit;
+    if(result > INT_MAX) { return INT_MAX; }
   }
-  ss>>result;
-  return result;
+  return (int)result;
 }
 
-llvm::Type* getType(string type)
-{
-  llvm::Type* LType;
-  if(type == "IntType")         
-  { LType = Builder.getInt32Ty();  } // 32 bit int
-  else if(type == "BoolType")  
-  { LType = Builder.getInt1Ty();   } // 1 bit int  
-  else if(type == "VoidType")  
-  { LType = Builder.getVoidTy();   } // void 
-  else if(type == "StringType") 
-  { LType = Builder.getInt8PtrTy();} // ptr to array of bytes
-  return LType;
+// printed names of decaf_type, as in the AST output
+static const char *type_names[] = { "", "IntType", "BoolType", "VoidType", "StringType", "IntArrayType" };
+
+string typeName(decaf_type type)
+{
+  return string(type_names[type]);
 }
 
-int getOperator(string op)
-{
-  if(op == "Plus")       { return T_PLUS;  }
-  if(op == "Minus")      { return T_MINUS; }
-  if(op == "Mult")       { return T_MULT;  }
-  if(op == "Div")        { return T_DIV;   }
-  if(op == "Leftshift")  { return T_LEFTSHIFT;   }
-  if(op == "Rightshift") { return T_RIGHTSHIFT;  }
-  if(op == "Mod")        { return T_MOD;   } 
-  if(op == "Eq")         { return T_EQ;    }
-  if(op == "Neq")        { return T_NEQ ;  }
-  if(op == "Lt")         { return T_LT;    }
-  if(op == "Leq")        { return T_LEQ;   }
-  if(op == "Gt")         { return T_GT;    }
-  if(op == "Geq")        { return T_GEQ;   }
-  if(op == "And")        { return T_AND;   }
-  if(op == "Or")         { return T_OR;    }
-  if(op == "Not")        { return T_NOT;   } 
-  if(op == "UnaryMinus") { return T_MINUS; }
-  return -1;
+llvm::Type* getType(decaf_type type)
+{
+  switch(type)
+  {
+    case TY_INT:    return Builder->getInt32Ty();    // 32 bit int
+    case TY_BOOL:   return Builder->getInt1Ty();     // 1 bit int  
+    case TY_VOID:   return Builder->getVoidTy();     // void 
+    case TY_STRING: return Builder->getInt8PtrTy();  // ptr to array of bytes
+    case TY_INTARRAY: return llvm::PointerType::getUnqual(Builder->getInt32Ty()); // first element
+    default:        return NULL;
+  }
 }
 
+// how Codegen lowers each operator
+typedef enum
+{
+  OPK_ARITH,  // integer binary instruction
+  OPK_CMP,    // signed integer compare, bool result
+  OPK_LOGIC,  // short circuit && and ||
+  OPK_UNARY
+} op_kind;
+
+typedef struct
+{
+  const char *name;     // printed name, as in the AST output
+  op_kind kind;
+  llvm::Instruction::BinaryOps opcode;
+  llvm::CmpInst::Predicate pred;
+  const char *tmpname;  // name of the IR value
+} op_info;
+
+// indexed by decaf_op
+static const op_info op_table[] = 
+{
+  { "Plus",       OPK_ARITH, llvm::Instruction::Add,  llvm::CmpInst::BAD_ICMP_PREDICATE, "addtmp" },
+  { "Minus",      OPK_ARITH, llvm::Instruction::Sub,  llvm::CmpInst::BAD_ICMP_PREDICATE, "subtmp" },
+  { "Mult",       OPK_ARITH, llvm::Instruction::Mul,  llvm::CmpInst::BAD_ICMP_PREDICATE, "multmp" },
+  { "Div",        OPK_ARITH, llvm::Instruction::SDiv, llvm::CmpInst::BAD_ICMP_PREDICATE, "divtmp" },
+  { "Leftshift",  OPK_ARITH, llvm::Instruction::Shl,  llvm::CmpInst::BAD_ICMP_PREDICATE, "lstmp"  },
+  { "Rightshift", OPK_ARITH, llvm::Instruction::LShr, llvm::CmpInst::BAD_ICMP_PREDICATE, "rstmp"  },
+  { "Mod",        OPK_ARITH, llvm::Instruction::SRem, llvm::CmpInst::BAD_ICMP_PREDICATE, "modtmp" },
+  { "Eq",         OPK_CMP,   llvm::Instruction::BinaryOpsEnd, llvm::CmpInst::ICMP_EQ,  "eqtmp"  },
+  { "Neq",        OPK_CMP,   llvm::Instruction::BinaryOpsEnd, llvm::CmpInst::ICMP_NE,  "neqtmp" },
+  { "Lt",         OPK_CMP,   llvm::Instruction::BinaryOpsEnd, llvm::CmpInst::ICMP_SLT, "lttmp"  },
+  { "Leq",        OPK_CMP,   llvm::Instruction::BinaryOpsEnd, llvm::CmpInst::ICMP_SLE, "leqtmp" },
+  { "Gt",         OPK_CMP,   llvm::Instruction::BinaryOpsEnd, llvm::CmpInst::ICMP_SGT, "gttmp"  },
+  { "Geq",        OPK_CMP,   llvm::Instruction::BinaryOpsEnd, llvm::CmpInst::ICMP_SGE, "geqtmp" },
+  { "And",        OPK_LOGIC, llvm::Instruction::BinaryOpsEnd, llvm::CmpInst::BAD_ICMP_PREDICATE, "phival" },
+  { "Or",         OPK_LOGIC, llvm::Instruction::BinaryOpsEnd, llvm::CmpInst::BAD_ICMP_PREDICATE, "phival" },
+  { "Not",        OPK_UNARY, llvm::Instruction::BinaryOpsEnd, llvm::CmpInst::BAD_ICMP_PREDICATE, "unottmp" },
+  { "UnaryMinus", OPK_UNARY, llvm::Instruction::BinaryOpsEnd, llvm::CmpInst::BAD_ICMP_PREDICATE, "unegtmp" }
+};
+
 static llvm::AllocaInst* CreateEntryBlockAlloca(llvm::Function *TheFunction, llvm::Type* VarType, const std::string &VarName)
 {
   llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(), TheFunction->getEntryBlock().begin());
   return TmpB.CreateAlloca(VarType, NULL, VarName.c_str());
 }
 
-template <class T>
-llvm::Value *listCodegen(list<T> vec)
+// ArrayElementPtr - address of Array[Index], Array points to an llvm array;
+// inbounds since decaf indexes are only valid inside the array
+static llvm::Value *ArrayElementPtr(llvm::Value *Array, llvm::Value *Index)
+{
+  llvm::Type *ArrayTy = Array->getType()->getPointerElementType();
+  llvm::Value *Idx[] = { Builder->getInt32(0), Index };
+  return Builder->CreateInBoundsGEP(ArrayTy, Array, Idx, "arrayindex");
+}
+
+// boundsTrap - the cold block of func that stops the program on an
+// index out of range, created on first use
+static llvm::BasicBlock *boundsTrap(llvm::Function *func)
+{
+  map<llvm::Function*, llvm::BasicBlock*>::iterator i = trapBlocks.find(func);
+  if(i != trapBlocks.end()) { return i->second; }
+
+  llvm::BasicBlock *TrapBB = llvm::BasicBlock::Create(*TheContext, "0_boundstrap", func);
+  llvm::IRBuilder<> TmpB(TrapBB);
+  TmpB.CreateCall(llvm::Intrinsic::getDeclaration(TheModule, llvm::Intrinsic::trap));
+  TmpB.CreateUnreachable();
+  trapBlocks[func] = TrapBB;
+  return TrapBB;
+}
+
+// emitBoundsCheck - continue in a new block if 0 <= Index < Length,
+// otherwise trap; the trap edge is weighted as never taken
+static void emitBoundsCheck(llvm::Value *Index, uint64_t Length)
+{
+  llvm::LLVMContext &C = *TheContext;
+  llvm::Function *func = Builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *OkBB = llvm::BasicBlock::Create(C, "0_inbounds", func);
+
+  // an unsigned compare catches negative indexes as well
+  llvm::Value *Ok = Builder->CreateICmpULT(Index, llvm::ConstantInt::get(Index->getType(), Length), "boundstmp");
+  Builder->CreateCondBr(Ok, OkBB, boundsTrap(func), llvm::MDBuilder(C).createBranchWeights(2000, 1));
+  Builder->SetInsertPoint(OkBB);
+}
+
+// blockTerminated - true once the current block ends in a return, break
+// or continue; anything generated after that would be unreachable
+static bool blockTerminated()
+{
+  llvm::BasicBlock *BB = Builder->GetInsertBlock();
+  return BB != NULL && BB->getTerminator() != NULL;
+}
+
+// defaultReturn - the value a method returns when it ends without a return
+// statement or with a bare return
+static llvm::Value *defaultReturn(llvm::Type *returnTy)
+{
+  if(returnTy->isVoidTy())       { return NULL; }
+  if(returnTy->isIntegerTy(32))  { return Builder->getInt32(0); }
+  return Builder->getInt1(1);
+}
+
+template <class T, class A>
+llvm::Value *listCodegen(list<T, A> &vec)
 {
   llvm::Value *val = NULL;
-  for (typename list<T>::iterator i = vec.begin(); i != vec.end(); i++)
+  for (typename list<T, A>::iterator i = vec.begin(); i != vec.end(); i++)
   { 
     llvm::Value *j = (*i)->Codegen();
     if (j != NULL) { val = j; }
@@ -133,12 +359,162 @@ llvm::Value *listCodegen(list<T> vec)
 class decafAST 
 {
 public:
+  decafAST() { astArena.track(this); }
   virtual ~decafAST() {}
+
+  // nodes live in the arena and are freed together by astArena.release()
+  static void *operator new(size_t n) { return astArena.allocate(n); }
+  static void operator delete(void *p) {}
+
   virtual string str()  { return string(""); }
   virtual string str_2(){ return string(""); }
   virtual llvm::Value *Codegen() = 0;
+
+  // constant folding: returns the node that replaces this one, env holds
+  // the locals currently known to be constant
+  virtual decafAST *Fold(fold_env &env) { return this; }
+  // names of the variables this statement may assign
+  virtual void assignedNames(set<int> &names) {}
+  // add the scalar variables a declaration introduces to env (as zero)
+  // and the names of the arrays it introduces to arrays
+  virtual void declare(fold_env &env, set<int> &arrays) {}
 };
 
+void phase_clock::stop(phase_time &phase) const
+{
+  chrono::duration<double> wall = chrono::steady_clock::now() - wall0;
+  phase.wall += wall.count();
+  phase.cpu  += (double)(clock() - cpu0) / CLOCKS_PER_SEC;
+}
+
+phase_time &time_report::phase(const string &name)
+{
+  for(size_t i = 0; i < phases.size(); ++i)
+  {
+    if(phases[i].name == name) { return phases[i]; }
+  }
+  phase_time p = { name, 0.0, 0.0 };
+  phases.push_back(p);
+  return phases.back();
+}
+
+void time_report::count(const string &name, unsigned long value, const string &phase)
+{
+  work_counter c = { name, value, phase };
+  counters.push_back(c);
+}
+
+void time_report::print_text(ostream &out)
+{
+  double wall = 0, cpu = 0;
+  char line[128];
+
+  out << "; ===== decafcomp time report =====" << endl;
+  snprintf(line, sizeof(line), ";   %-20s %12s %12s", "phase", "wall ms", "cpu ms");
+  out << line << endl;
+  for(size_t i = 0; i < phases.size(); ++i)
+  {
+    snprintf(line, sizeof(line), ";   %-20s %12.3f %12.3f", phases[i].name.c_str(), phases[i].wall * 1e3, phases[i].cpu * 1e3);
+    out << line << endl;
+    wall += phases[i].wall;
+    cpu  += phases[i].cpu;
+  }
+  snprintf(line, sizeof(line), ";   %-20s %12.3f %12.3f", "total", wall * 1e3, cpu * 1e3);
+  out << line << endl;
+
+  // throughput of each counter over the wall time of its phase
+  for(size_t i = 0; i < counters.size(); ++i)
+  {
+    double t = phase(counters[i].phase).wall;
+    snprintf(line, sizeof(line), ";   %-20s %12lu %14.0f/s in %s", counters[i].name.c_str(), counters[i].value,
+             t > 0 ? counters[i].value / t : 0.0, counters[i].phase.c_str());
+    out << line << endl;
+  }
+}
+
+void time_report::print_json(ostream &out)
+{
+  out << "{\"phases\": [";
+  for(size_t i = 0; i < phases.size(); ++i)
+  {
+    out << (i ? ", " : "") << "{\"name\": \"" << phases[i].name << "\", \"wall_ms\": " << phases[i].wall * 1e3
+        << ", \"cpu_ms\": " << phases[i].cpu * 1e3 << "}";
+  }
+  out << "], \"counters\": [";
+  for(size_t i = 0; i < counters.size(); ++i)
+  {
+    double t = phase(counters[i].phase).wall;
+    out << (i ? ", " : "") << "{\"name\": \"" << counters[i].name << "\", \"value\": " << counters[i].value
+        << ", \"phase\": \"" << counters[i].phase << "\", \"per_second\": " << (t > 0 ? counters[i].value / t : 0.0) << "}";
+  }
+  out << "]}" << endl;
+}
+
+// countInstructions - number of IR instructions in the module's functions
+unsigned long countInstructions(llvm::Module *M)
+{
+  unsigned long n = 0;
+  for(llvm::Module::iterator f = M->begin(); f != M->end(); ++f)
+  {
+    for(llvm::Function::iterator b = f->begin(); b != f->end(); ++b)
+    {
+      n += b->size();
+    }
+  }
+  return n;
+}
+
+// foldChild - fold e, a replaced node is left for the arena to free
+decafAST *foldChild(decafAST *e, fold_env &env)
+{
+  if(e == NULL) { return NULL; }
+  return e->Fold(env);
+}
+
+void *ast_arena::allocate(size_t n)
+{
+  // keep every node suitably aligned
+  const size_t align = alignof(max_align_t);
+  n = (n + align - 1) & ~(align - 1);
+  if(n > left)
+  {
+    size_t size = n > BLOCK_SIZE ? n : BLOCK_SIZE;
+    char *block = new char[size];
+    blocks.push_back(block);
+    cur  = block;
+    left = size;
+  }
+  void *p = cur;
+  cur  += n;
+  left -= n;
+  return p;
+}
+
+void ast_arena::release()
+{
+  for(size_t i = nodes.size(); i > 0; --i)
+  {
+    nodes[i - 1]->~decafAST();
+  }
+  nodes.clear();
+  for(size_t i = 0; i < blocks.size(); ++i)
+  {
+    delete [] blocks[i];
+  }
+  blocks.clear();
+  cur  = NULL;
+  left = 0;
+}
+
+// eraseNames - forget the constant values of names
+void eraseNames(fold_env &env, set<int> &names)
+{
+  for(set<int>::iterator i = names.begin(); i != names.end(); ++i)
+  {
+    env.erase(*i);
+  }
+}
+
 string char_to_ascii_string(string str)
 {
   if(str.empty())
@@ -244,11 +620,11 @@ string getString(decafAST *d)
 }
 
 
-template <class T>
-string commaList(list<T> vec) 
+template <class T, class A>
+string commaList(list<T, A> &vec) 
 {
   string s("");
-  for (typename list<T>::iterator i = vec.begin(); i != vec.end(); i++)
+  for (typename list<T, A>::iterator i = vec.begin(); i != vec.end(); i++)
   { 
     s = s + (s.empty() ? string("") : string(",")) + (*i)->str(); 
   }   
@@ -264,18 +640,12 @@ string commaList(list<T> vec)
 
 /// decafStmtList - List of Decaf statements
 class decafStmtList : public decafAST {
-  list<decafAST *> stmts;
+  ast_list stmts;
 public:
   decafStmtList() {}
-  ~decafStmtList()
-  {
-    for (list<decafAST *>::iterator i = stmts.begin(); i != stmts.end(); i++)
-    { 
-      delete *i;
-    }
-  }
 
   int size() { return stmts.size(); }
+  decafAST *front() { return stmts.front(); }
   void push_front(decafAST *e) { stmts.push_front(e); }
   void push_back(decafAST *e)  { stmts.push_back(e);  }
 
@@ -295,41 +665,75 @@ public:
 
   list<decafAST*> return_list()
   {
-    return stmts;
+    return list<decafAST*>(stmts.begin(), stmts.end());
   }
   string str()    { return commaList<class decafAST *>(stmts); }
   llvm::Value *Codegen() { return listCodegen<decafAST *>(stmts); }
+
+  decafAST *Fold(fold_env &env)
+  {
+    for (ast_list::iterator i = stmts.begin(); i != stmts.end(); i++)
+    { 
+      *i = foldChild(*i, env);
+    }
+    return this;
+  }
+  void assignedNames(set<int> &names)
+  {
+    for (ast_list::iterator i = stmts.begin(); i != stmts.end(); i++)
+    { 
+      (*i)->assignedNames(names);
+    }
+  }
+  void declare(fold_env &env, set<int> &arrays)
+  {
+    for (ast_list::iterator i = stmts.begin(); i != stmts.end(); i++)
+    { 
+      (*i)->declare(env, arrays);
+    }
+  }
 };
 
 class VarDefAST : public decafAST
 {
-  string Name;
-  string VarType;
+  const string &Name;   // owned by symnames
+  int NameId;
+  decaf_type VarType;
   bool   isParam;
+  int    ArraySize;   // number of elements of a local array, 0 for a scalar
 public:
   
-  VarDefAST(string name, string type, bool param_flag) : Name(name), VarType(type), isParam(param_flag)
+  VarDefAST(int nameId, decaf_type type, bool param_flag) 
+    : Name(symnames.name(nameId)), NameId(nameId), VarType(type), isParam(param_flag), ArraySize(0)
+  {
+  }
+
+  VarDefAST(int nameId, decaf_type type, int length) 
+    : Name(symnames.name(nameId)), NameId(nameId), VarType(type), isParam(false), ArraySize(length)
   {
   }
-  ~VarDefAST(){};
   
   string str()
   {
-    if(VarType.empty())
+    if(VarType == TY_NONE)
     {
       return string(""); // no argument       
     }
     else if(Name.empty())
     {
-      return string("VarDef") + "(" + VarType + ")";
+      return string("VarDef") + "(" + typeName(VarType) + ")";
+    }
+    else if(ArraySize > 0)
+    {
+      return string("VarDef") + "(" + Name + "," + typeName(VarType) + ",Array(" + to_string(ArraySize) + "))";
     }
     else
     {
-      return string("VarDef") + "(" + Name + "," + VarType + ")";
+      return string("VarDef") + "(" + Name + "," + typeName(VarType) + ")";
     }
   }  
 
-  string getVarType()
+  decaf_type getVarType()
   {
     return VarType;
   }
@@ -339,6 +743,19 @@ public:
     return Name;
   }
 
+  void declare(fold_env &env, set<int> &arrays)
+  {
+    if(ArraySize > 0)
+    {
+      arrays.insert(NameId);
+    }
+    else if(!isParam && !Name.empty())
+    {
+      fold_value zero = { VarType, 0 };
+      env[NameId] = zero;
+    }
+  }
+
   llvm::Value *Codegen() 
   {
     debug_print(debug_flag,"...VarDef Codegen Begins...");
@@ -348,10 +765,29 @@ public:
     llvm::Type  *LType = getType(VarType);
     llvm::AllocaInst *Alloca = NULL;
 
-    if(isParam == false)
+    if(ArraySize > 0)
+    {
+      // the whole array lives in the entry block's frame, cleared to zero
+      // each time the declaration is reached like a scalar would be
+      llvm::Function *func = Builder->GetInsertBlock()->getParent();
+      llvm::ArrayType *ArrayTy = llvm::ArrayType::get(LType, ArraySize);
+      Alloca = CreateEntryBlockAlloca(func, ArrayTy, Name);
+      Alloca->setAlignment(LOCAL_ARRAY_ALIGNMENT);
+
+      uint64_t Bytes = TheModule->getDataLayout().getTypeAllocSize(ArrayTy);
+      Builder->CreateMemSet(Alloca, Builder->getInt8(0), Bytes, LOCAL_ARRAY_ALIGNMENT);
+      symtbl.insert(NameId, Alloca);
+    }
+    else if(isParam == false)
     { 
-      Alloca = Builder.CreateAlloca(LType, NULL, Name);
-      (symtbl.front())[Name] = Alloca;
+      // hoist the slot into the entry block so that a declaration inside
+      // a loop body does not grow the stack and mem2reg can promote it
+      llvm::Function *func = Builder->GetInsertBlock()->getParent();
+      Alloca = CreateEntryBlockAlloca(func, LType, Name);
+
+      // decaf variables start out as zero (false for bool)
+      Builder->CreateStore(llvm::Constant::getNullValue(LType), Alloca);
+      symtbl.insert(NameId, Alloca);
     } 
 
     debug_print(debug_flag,"...VarDef Codegen Ends...");
@@ -361,27 +797,36 @@ public:
 
 class ConstantAST : public decafAST
 {
-  string Type;
+  decaf_type Type;
   string Value;
+  int IntValue; // Value decoded once for int and bool constants
 
 public:
-  ConstantAST(string type, string value) : Type(type), Value(value)
+  ConstantAST(decaf_type type, string value) : Type(type), Value(value), IntValue(0)
   {
-   
+    if(Type == TY_INT) { IntValue = string_to_int(Value); }
   } 
+  ConstantAST(decaf_type type, int value) : Type(type), IntValue(value)
+  {
+    if(Type == TY_BOOL) { Value = value ? "True" : "False"; }
+    else                { Value = to_string(value);         }
+  }
+
+  decaf_type getType() { return Type; }
+  int getIntValue() { return IntValue; }
   
   string str()
   {
     string Name;
-    if(Type == string("IntType"))
+    if(Type == TY_INT)
     {
       Name = string("NumberExpr");
     }
-    else if(Type == string("StringType"))
+    else if(Type == TY_STRING)
     {
       Name = string("StringConstant");
     }
-    else if(Type == string("BoolType"))
+    else if(Type == TY_BOOL)
     {
       Name = string("BoolExpr");
     }    
@@ -391,19 +836,18 @@ public:
   {
     llvm::Constant *Const;
 
-    if(Type == "IntType")
+    if(Type == TY_INT)
     { 
-      Const = Builder.getInt32(string_to_int(Value));
+      Const = Builder->getInt32(IntValue);
     }
-    else if(Type == "BoolType")
+    else if(Type == TY_BOOL)
     { 
-      if(Value == "True" ) { Const = Builder.getInt1(1);}
-      if(Value == "False") { Const = Builder.getInt1(0);}
+      Const = Builder->getInt1(IntValue != 0);
     }
-    else if(Type == "StringType")
+    else if(Type == TY_STRING)
     {
-      llvm::GlobalVariable *GS = Builder.CreateGlobalString(Value.c_str(), "globalstring");
-      return Builder.CreateConstGEP2_32(GS->getValueType(), GS, 0, 0, "cast");
+      llvm::GlobalVariable *GS = Builder->CreateGlobalString(Value.c_str(), "globalstring");
+      return Builder->CreateConstGEP2_32(GS->getValueType(), GS, 0, 0, "cast");
     }
     return (llvm::Value*)Const;
   }
@@ -412,21 +856,18 @@ public:
 
 class ExternAST : public decafAST
 {
-  string Name;
+  const string &Name;   // owned by symnames
+  int NameId;
   decafStmtList* ExternTypeList;
-  string MethodType; 
+  decaf_type MethodType; 
 
 public: 
-  ExternAST(string name, decafStmtList* elist, string mtype) 
-  : Name(name), ExternTypeList(elist), MethodType(mtype){}  
-  ~ExternAST()  
-  {
-    if(ExternTypeList != NULL) { delete ExternTypeList; }
-  }
+  ExternAST(int nameId, decafStmtList* elist, decaf_type mtype) 
+  : Name(symnames.name(nameId)), NameId(nameId), ExternTypeList(elist), MethodType(mtype){}  
 
   string str()
   {
-    return string("ExternFunction") + "(" + Name + "," + MethodType + "," + getString(ExternTypeList)+ ")";
+    return string("ExternFunction") + "(" + Name + "," + typeName(MethodType) + "," + getString(ExternTypeList)+ ")";
   }
   llvm::Value *Codegen() 
   {
@@ -444,8 +885,8 @@ public:
       for (list<decafAST*>::iterator i = stmts.begin(); i != stmts.end(); i++)
       { 
         
-        string type =  ((VarDefAST*)(*i))->getVarType();
-        if(type.empty())
+        decaf_type type =  ((VarDefAST*)(*i))->getVarType();
+        if(type == TY_NONE)
 	{
           args.clear();
           break;      
@@ -466,7 +907,7 @@ public:
    
     verifyFunction(*func);
     val = (llvm::Value*)func;
-    (symtbl.front())[Name] = val; 
+    symtbl.insert(NameId, val); 
     debug_print(debug_flag,"...Extern Codegen Ends...");
     return val; 
   }
@@ -484,16 +925,46 @@ class BlockAST : public decafAST
 public:
   BlockAST(decafStmtList* varlist, decafStmtList* stmtlist)
          : VarDeclList(varlist), StmtList(stmtlist),MethodBlock(false){}
-  ~BlockAST()
-  {
-    if(VarDeclList != NULL) { delete VarDeclList; }
-    if(StmtList    != NULL) { delete StmtList;    }
-  }
     
   void setMethodBlock(bool flag)
   {
     MethodBlock = flag;
   }
+
+  decafAST *Fold(fold_env &env)
+  {
+    // locals of this block start out as zero and shadow outer names; a
+    // local array hides any constant scalar of the same name
+    fold_env decls;
+    set<int> arrays;
+    if(VarDeclList != NULL) { VarDeclList->declare(decls, arrays); }
+
+    fold_env inner = env;
+    for(fold_env::iterator i = decls.begin(); i != decls.end(); ++i)
+    {
+      inner[i->first] = i->second;
+    }
+    eraseNames(inner, arrays);
+
+    if(StmtList != NULL) { StmtList->Fold(inner); }
+
+    // the block runs straight through, so outer names leave it with the
+    // values they had at its end
+    for(fold_env::iterator i = env.begin(); i != env.end(); )
+    {
+      fold_env::iterator cur = i++;
+      if(decls.count(cur->first) != 0 || arrays.count(cur->first) != 0) { continue; }
+
+      fold_env::iterator j = inner.find(cur->first);
+      if(j == inner.end()) { env.erase(cur); }
+      else                 { cur->second = j->second; }
+    }
+    return this;
+  }
+  void assignedNames(set<int> &names)
+  {
+    if(StmtList != NULL) { StmtList->assignedNames(names); }
+  }
   
   string str()
   {
@@ -512,12 +983,12 @@ public:
   {
     debug_print(debug_flag, "...Block Codegen Begins...");
 
-    symtbl.push_front(symbol_table());
+    symtbl.push_scope();
     
     // if it's a method block
     if(MethodBlock)
     {
-      llvm::BasicBlock* CurBB   = Builder.GetInsertBlock();
+      llvm::BasicBlock* CurBB   = Builder->GetInsertBlock();
       llvm::Function* func      = CurBB->getParent();
       llvm::StringRef func_name = func->getName();
       llvm::AllocaInst* Alloca;
@@ -530,18 +1001,25 @@ public:
         arg_name = (*i).getName(); 
         //cout<<arg_name<<endl;
 
-        Alloca = Builder.CreateAlloca((*i).getType() , NULL, (*i).getName());    
-        Builder.CreateStore(&(*i), Alloca);  
-        (symtbl.front())[arg_name] = (llvm::Value*)Alloca;
+        Alloca = CreateEntryBlockAlloca(func, (*i).getType(), arg_name);    
+        Builder->CreateStore(&(*i), Alloca);  
+        symtbl.insert(symnames.intern(arg_name), (llvm::Value*)Alloca);
       }
     }
 
     if(VarDeclList != NULL) { VarDeclList->Codegen(); }
-    if(StmtList    != NULL) { StmtList->Codegen();    } 
+    if(StmtList    != NULL) 
+    { 
+      list<decafAST*> stmts = StmtList->return_list();
+      for(list<decafAST*>::iterator i = stmts.begin(); i != stmts.end(); i++)
+      {
+        // statements after a return, break or continue are dead
+        if(blockTerminated()) { break; }
+        (*i)->Codegen();
+      }
+    } 
     
-    symbol_table sym_table = symtbl.front();
-    //free_element(sym_table);
-    symtbl.pop_front(); 
+    symtbl.pop_scope(); 
 
     debug_print(debug_flag, "...Block Codegen Ends...");
     return NULL;
@@ -550,30 +1028,34 @@ public:
 
 class MethodAST : public decafAST
 {
-  string Name;
-  string MethodType;
+  const string &Name;   // owned by symnames
+  int NameId;
+  decaf_type MethodType;
   decafStmtList *ArgList;
   BlockAST *Block;
+  inline_hint Inline;
   
 public:
-  MethodAST(string name, string type, decafStmtList* alist, BlockAST* block) 
-    : Name(name), MethodType(type), ArgList(alist), Block(block){}
-  ~MethodAST()
-  {
-    if(ArgList != NULL) { delete ArgList;}
-    if(Block   != NULL) { delete Block;  }
-  }
+  MethodAST(int nameId, decaf_type type, decafStmtList* alist, BlockAST* block, inline_hint hint) 
+    : Name(symnames.name(nameId)), NameId(nameId), MethodType(type), ArgList(alist), Block(block), Inline(hint){}
 
   string getName()
   {
     return Name;
   }
 
+  decafAST *Fold(fold_env &env)
+  {
+    fold_env locals;
+    if(Block != NULL) { Block->Fold(locals); }
+    return this;
+  }
+
   string str()
   {
     return string("Method") 
                   + "(" 
-                  + Name + "," + MethodType + "," + getString(ArgList) + "," + getString(Block)
+                  + Name + "," + typeName(MethodType) + "," + getString(ArgList) + "," + getString(Block)
                   + ")";
   }
 
@@ -607,11 +1089,17 @@ public:
       arg_names.push_back(arg_name);  
     }   
 
+    // only main is called from outside; internal methods can be dropped
+    // once the inliner has inlined all their calls
     func = llvm::Function::Create(llvm::FunctionType::get(returnTy, arg_types, false),
-                                  llvm::Function::ExternalLinkage,
+                                  Name == "main" ? llvm::Function::ExternalLinkage 
+                                                 : llvm::Function::InternalLinkage,
                                   Name,
                                   TheModule
                      		 );
+
+    if(Inline == INLINE_ALWAYS)     { func->addFnAttr(llvm::Attribute::AlwaysInline); }
+    else if(Inline == INLINE_NEVER) { func->addFnAttr(llvm::Attribute::NoInline);     }
   
     unsigned int Idx = 0;
     for(auto &Arg : func->args())
@@ -620,7 +1108,7 @@ public:
     }
 
     // assuming there are no function duplicates....
-    (symtbl.front())[Name] = (llvm::Value*) func;
+    symtbl.insert(NameId, (llvm::Value*) func);
 
     return func;
   }
@@ -629,7 +1117,7 @@ public:
   {
     debug_print(debug_flag,"...Method Codegen Begins...");
 
-    llvm::Function *func = (llvm::Function*)access_symtbl(Name);
+    llvm::Function *func = (llvm::Function*)symtbl.lookup(NameId);
     llvm::Type *returnTy = getType(MethodType);
 
     list<decafAST*> stmts;
@@ -641,37 +1129,33 @@ public:
     }
     
     // create a new basic block which contains a sequence of LLVM instructions 
-    llvm::BasicBlock *BB = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", func);
+    llvm::BasicBlock *BB = llvm::BasicBlock::Create(*TheContext, "entry", func);
 
     // insert "entry" into symbol table (will be used in hw4)
        
     // all subsequent calls to IRBuilder wlil place instructions in this location 
-    Builder.SetInsertPoint(BB);
+    Builder->SetInsertPoint(BB);
     
     if(Block != NULL) 
     {
       Block->Codegen(); 
     }
 
-    if(returnValue == NULL)    
+    // the default return, unless the block already ended in a return
+    if(!blockTerminated())    
     {
-      if(returnTy->isVoidTy())
-      { 
-        Builder.CreateRet(NULL);
-      }
-      else
-      {
-        // create default return 
-        if(returnTy->isIntegerTy(32)) 
-        { returnValue = Builder.getInt32(0); }
-        else //if(returnTy->isIntegerTy(1))  
-        { returnValue = Builder.getInt1(1) ; } 
-        Builder.CreateRet(returnValue);
-        returnValue = NULL;
-      }
+      Builder->CreateRet(defaultReturn(returnTy));
     }
 
+    phase_clock clock;
     verifyFunction(*func);
+
+    // promote the entry block allocas to SSA registers
+    if(TheFPM != NULL)
+    {
+      TheFPM->run(*func);
+    }
+    clock.stop(timeReport.phase("verify+mem2reg"));
   
     debug_print(debug_flag,"...Method Codegen Ends..."); 
  
@@ -688,16 +1172,17 @@ class PackageAST : public decafAST
 public:
   PackageAST(string name, decafStmtList *fieldlist, decafStmtList *methodlist) 
 	    : Name(name), FieldDeclList(fieldlist), MethodDeclList(methodlist) {}
-  ~PackageAST() 
-  { 
-    if (FieldDeclList  != NULL) { delete FieldDeclList;  }
-    if (MethodDeclList != NULL) { delete MethodDeclList; }
-  }
 
   string str() 
   { 
     return string("Package") + "(" + Name + "," + getString(FieldDeclList) + "," + getString(MethodDeclList) + ")";
   }
+  decafAST *Fold(fold_env &env)
+  {
+    if (FieldDeclList  != NULL) { FieldDeclList->Fold(env);  }
+    if (MethodDeclList != NULL) { MethodDeclList->Fold(env); }
+    return this;
+  }
   llvm::Value *Codegen() 
   {
     debug_print(debug_flag,"...Package Codegen Begins...");
@@ -741,13 +1226,13 @@ class ProgramAST : public decafAST
 
 public:
   ProgramAST(decafStmtList *externs, PackageAST *c) : ExternList(externs), PackageDef(c) {}
-  ~ProgramAST() 
-  { 
-    if (ExternList != NULL)  { delete ExternList; } 
-    if (PackageDef != NULL)  { delete PackageDef; }
-  }
 
   string str() { return string("Program") + "(" + getString(ExternList) + "," + getString(PackageDef) + ")"; }
+  decafAST *Fold(fold_env &env)
+  {
+    if (PackageDef != NULL) { PackageDef->Fold(env); }
+    return this;
+  }
   llvm::Value *Codegen() 
   {
     llvm::Value *val = NULL;
@@ -771,33 +1256,41 @@ public:
 
 class FieldAST : public decafAST
 {
-  string Name;
-  string FieldType;
+  const string &Name;   // owned by symnames
+  int NameId;
+  decaf_type FieldType;
   string FieldSize;
+  int ArraySize;        // number of elements, 0 for a scalar
   decafAST* Expr;
   bool Assignment;
 public:
   
-  FieldAST(string name, string type, string size, bool isAssign) 
-    : Name(name), FieldType(type), FieldSize(size), Assignment(isAssign) { }
+  FieldAST(int nameId, decaf_type type, string size, int length, bool isAssign) 
+    : Name(symnames.name(nameId)), NameId(nameId), FieldType(type), FieldSize(size), ArraySize(length), Expr(NULL), Assignment(isAssign) { }
    
-  FieldAST(string name, string type, decafAST* argument, bool isAssign) 
-    : Name(name), FieldType(type), Expr(argument), Assignment(isAssign) { } 
-  ~FieldAST()
-  {
-    if(Expr != NULL) { delete Expr; }
-  }
+  FieldAST(int nameId, decaf_type type, decafAST* argument, bool isAssign) 
+    : Name(symnames.name(nameId)), NameId(nameId), FieldType(type), ArraySize(0), Expr(argument), Assignment(isAssign) { } 
 
   string str()
   {
     if(Assignment == true)
     {
-      return string("AssignGlobalVar") + "(" + Name + "," + FieldType + "," + getString(Expr) +")"; 
+      return string("AssignGlobalVar") + "(" + Name + "," + typeName(FieldType) + "," + getString(Expr) +")"; 
     } 
     else
     {
-      return string("FieldDecl") + "(" + Name + "," + FieldType + "," + FieldSize + ")";
+      return string("FieldDecl") + "(" + Name + "," + typeName(FieldType) + "," + FieldSize + ")";
+    }
+  }
+  decafAST *Fold(fold_env &env)
+  {
+    // global initializers only ever see literals
+    if(Assignment)
+    {
+      fold_env none;
+      Expr = foldChild(Expr, none);
     }
+    return this;
   }
   llvm::Value *Codegen() 
   {
@@ -817,8 +1310,8 @@ public:
     } 
     else
     {
-      if(GVType->isIntegerTy(32))     { Initializer = Builder.getInt32(0); }
-      else if(GVType->isIntegerTy(1)) { Initializer = Builder.getInt1(0) ; }
+      if(GVType->isIntegerTy(32))     { Initializer = Builder->getInt32(0); }
+      else if(GVType->isIntegerTy(1)) { Initializer = Builder->getInt1(0) ; }
       else if(GVType->isVoidTy())     { Initializer = NULL; }
     }
     
@@ -839,19 +1332,27 @@ public:
     }
     else // global array 
     {
-      llvm::ArrayType *arrayi32 = llvm::ArrayType::get(GVType, 10);  
-      llvm::Constant  *zeroInit = llvm::Constant::getNullValue(arrayi32);
+      if(ArraySize <= 0)
+      {
+        throw runtime_error("array size must be greater than 0: " + Name);
+      }
+      // a zeroinitializer is a single constant whatever the size, the
+      // backend puts the array in .bss
+      llvm::ArrayType *arrayTy  = llvm::ArrayType::get(GVType, ArraySize);  
+      llvm::Constant  *zeroInit = llvm::Constant::getNullValue(arrayTy);
       GV = new llvm::GlobalVariable(*TheModule, 
-                                    arrayi32, 
+                                    arrayTy, 
                                     false, 
-                                    llvm::GlobalValue::ExternalLinkage, 
+                                    llvm::GlobalValue::InternalLinkage, 
                                     zeroInit, 
                                     Name);
+      // cache line aligned, wide enough for any vector load
+      GV->setAlignment(ARRAY_ALIGNMENT);
     }
 
   
     if(GV == NULL) { cout<<"GV "<<Name<<" is NULL "<<endl;}
-    (symtbl.front())[Name] = (llvm::Value*) GV;
+    symtbl.insert(NameId, (llvm::Value*) GV);
     //cout<<"Storing name in symtbl: "<<Name<<endl;
 
     debug_print(debug_flag, "...FieldDecl Codegen Ends...");
@@ -859,88 +1360,22 @@ public:
   }
 };
 
-class MethodCallAST : public decafAST
+class ValueAST : public decafAST
 {
-  string Name;
-  decafStmtList *ArgList;
+  const string &Name;   // owned by symnames
+  int NameId;
+  decafStmtList* IndexExpr;
+  bool ArrayFlag;
 
 public: 
-  MethodCallAST(string name, decafStmtList *alist) : Name(name), ArgList(alist)
-  {
-    
-  }  
-  ~MethodCallAST()
-  {
-    if(ArgList != NULL) { delete ArgList; }
-  }
-
-  string str()
-  {
-    return string("MethodCall") + "(" + Name + "," + getString(ArgList) +")"; 
-  }
-  llvm::Value *Codegen() 
-  {
-    // CreateEntryBlockAlloca with the variable_name and type 
-    debug_print(debug_flag, "...MethodCall Codegen Begins...");
-
-    llvm::Value* val = NULL;
-    llvm::Function* func = (llvm::Function*)access_symtbl(Name);
-    list<decafAST*> stmts;
-    vector<llvm::Value*> arg_values;
-    vector<llvm::Type*> arg_types;
-    llvm::Function *call;
-    bool isVoid;
-
-    if(ArgList != NULL)
-    {
-      stmts = ArgList->return_list();
-    }
-    
-    if(func != NULL) 
-    {
-      llvm::Function::arg_iterator args;   
-      call = func; 
-   
-      for (list<decafAST*>::iterator i = stmts.begin(); i != stmts.end(); i++, args++)
-      {         
-        args = call->arg_begin();
- 	llvm::Value* arg_value = (*i)->Codegen();  
-	llvm::Type*  arg_type  = (*args).getType();
-        
-        if(arg_value->getType()->isIntegerTy(1) && arg_type->isIntegerTy(32))
-	{
-	  arg_value = Builder.CreateZExt(arg_value, Builder.getInt32Ty(), "zexttmp");  
-	}
-        
-        arg_values.push_back(arg_value);    
-      }   
-    }
-
-    isVoid    = call->getReturnType()->isVoidTy();
-    val       = Builder.CreateCall(call, arg_values, isVoid ? "" : "calltmp"); 
-    debug_print(debug_flag, "...MethodCall Codegen Ends...");
-    return val;
-  }
-};
-
-class ValueAST : public decafAST
-{
-  string Name;
-  decafStmtList* IndexExpr;
-  bool ArrayFlag;
-
-public: 
-  ValueAST(string name) : Name(name), ArrayFlag(false), IndexExpr(NULL) {}
-  ValueAST(string name, decafStmtList* index) : Name(name), IndexExpr(index), ArrayFlag(true){}
-  ~ValueAST()
-  {
-    if(IndexExpr != NULL) { delete IndexExpr; }
-  }
-   
-  string getName() { return Name; }  
-  decafStmtList* getIndexExpr() { return IndexExpr; }
-  bool isArray() { return ArrayFlag; }	
-	   
+  ValueAST(int nameId) : Name(symnames.name(nameId)), NameId(nameId), IndexExpr(NULL), ArrayFlag(false) {}
+  ValueAST(int nameId, decafStmtList* index) : Name(symnames.name(nameId)), NameId(nameId), IndexExpr(index), ArrayFlag(true){}
+   
+  string getName() { return Name; }  
+  int getNameId() { return NameId; }
+  decafStmtList* getIndexExpr() { return IndexExpr; }
+  bool isArray() { return ArrayFlag; }	
+	   
   string str()
   {
     if(ArrayFlag == false)
@@ -952,12 +1387,27 @@ public:
       return string("ArrayLocExpr") + "(" + Name + "," + getString(IndexExpr) +")";
     }  
   }
+  decafAST *Fold(fold_env &env)
+  {
+    if(ArrayFlag)
+    {
+      IndexExpr = (decafStmtList*)foldChild(IndexExpr, env);
+      return this;
+    }
+
+    fold_env::iterator i = env.find(NameId);
+    if(i != env.end())
+    {
+      return new ConstantAST(i->second.type, i->second.value);
+    }
+    return this;
+  }
   llvm::Value *Codegen() 
   {
     debug_print(debug_flag,"...Value Codegen Begins...");
     
     //cout<<"Accessing name in symtbl: "<<Name<<endl;
-    llvm::Value* val = access_symtbl(Name);
+    llvm::Value* val = symtbl.lookup(NameId);
 
     if(val == NULL)
     {
@@ -966,20 +1416,67 @@ public:
 
     if(ArrayFlag == false)
     {
-      val = Builder.CreateLoad(val,Name);         
+      val = Builder->CreateLoad(val,Name);         
     }
     else
     { 
-      llvm::GlobalVariable * GV = (llvm::GlobalVariable*)val;
-      llvm::ArrayType *arrayi32 = (llvm::ArrayType*)GV->getType();
-      llvm::Value     *ArrayLoc = Builder.CreateStructGEP(arrayi32, GV, 0, "arrayloc");
-      llvm::Value     *Index    = IndexExpr->Codegen() ;
-      llvm::Value   *ArrayIndex = Builder.CreateGEP(arrayi32->getElementType(), ArrayLoc, Index, "arrayindex");
-      val = Builder.CreateLoad(ArrayIndex, "loadtmp");
+      llvm::Value *ArrayIndex = ElementPtr(val);
+      val = Builder->CreateLoad(ArrayIndex, "loadtmp");
     }
     debug_print(debug_flag,"...Value Codegen Ends...");
     return val;
   }
+
+  // ElementPtr - address of Array[IndexExpr]; with -fbounds-check the
+  // access is checked unless the index is known to be in range
+  llvm::Value *ElementPtr(llvm::Value *Array)
+  {
+    llvm::Value *Index = IndexExpr->Codegen();
+    if(boundsCheck)
+    {
+      uint64_t Length = Array->getType()->getPointerElementType()->getArrayNumElements();
+      if(!indexInRange(Length))
+      {
+        emitBoundsCheck(Index, Length);
+      }
+    }
+    return ArrayElementPtr(Array, Index);
+  }
+
+  // indexInRange - true if IndexExpr is a constant or a for loop variable
+  // whose values all lie in [0, Length)
+  bool indexInRange(uint64_t Length)
+  {
+    decafAST *e = (decafAST*)IndexExpr;
+
+    ConstantAST *c = dynamic_cast<ConstantAST*>(e);
+    if(c != NULL)
+    {
+      return c->getIntValue() >= 0 && (uint64_t)c->getIntValue() < Length;
+    }
+
+    ValueAST *v = dynamic_cast<ValueAST*>(e);
+    if(v != NULL && !v->isArray())
+    {
+      map<llvm::Value*, pair<int, int> >::iterator i = indexRanges.find(symtbl.lookup(v->getNameId()));
+      if(i != indexRanges.end())
+      {
+        return i->second.first >= 0 && (uint64_t)i->second.second < Length;
+      }
+    }
+    return false;
+  }
+
+  // Address - pointer to the first element of the global or local array Name
+  llvm::Value *Address()
+  {
+    llvm::Value* val = symtbl.lookup(NameId);
+    if(val == NULL || !val->getType()->getPointerElementType()->isArrayTy())
+    {
+      throw runtime_error("not an array: " + Name);
+    }
+    return ArrayElementPtr(val, Builder->getInt32(0));
+  }
 };  
 
 class AssignAST : public decafAST
@@ -992,11 +1489,9 @@ public:
   {
 
   }
-  ~AssignAST()
-  {
-    if(Value != NULL) { delete Value; }
-    if(Expr  != NULL) { delete Expr;  }
-  }
+
+  ValueAST *getValue() { return Value; }
+  decafAST *getExpr()  { return Expr;  }
   
   string str()
   {
@@ -1012,6 +1507,28 @@ public:
       return Name + "(" + Value->getName() + "," + getString(Value->getIndexExpr()) + ","+ getString(Expr) + ")";
     } 
   }
+  decafAST *Fold(fold_env &env)
+  {
+    // the target itself is an lvalue, only its index is folded
+    if(Value->isArray()) { Value->Fold(env); }
+    Expr = foldChild(Expr, env);
+
+    if(!(Value->isArray()))
+    {
+      fold_env::iterator i = env.find(Value->getNameId());
+      ConstantAST *c = dynamic_cast<ConstantAST*>(Expr);
+      if(i != env.end())
+      {
+        if(c != NULL && c->getType() != TY_STRING) { i->second.value = c->getIntValue(); }
+        else                                          { env.erase(i); }
+      }
+    }
+    return this;
+  }
+  void assignedNames(set<int> &names)
+  {
+    if(!(Value->isArray())) { names.insert(Value->getNameId()); }
+  }
   llvm::Value *Codegen() 
   {
     debug_print(debug_flag,"...Assign Codegen Begins...");
@@ -1019,15 +1536,10 @@ public:
     llvm::Value *LValue;
     llvm::Value *RValue;
 
-    LValue = access_symtbl(Value->getName());    
+    LValue = symtbl.lookup(Value->getNameId());    
     if(Value->isArray())
     {   
-      llvm::GlobalVariable * GV = (llvm::GlobalVariable*)LValue;
-      llvm::ArrayType *arrayi32 = (llvm::ArrayType*)GV->getType();
-      llvm::Value     *ArrayLoc = Builder.CreateStructGEP(arrayi32, GV, 0, "arrayloc");
-      llvm::Value     *Index    = (Value->getIndexExpr())->Codegen() ;
-      llvm::Value   *ArrayIndex = Builder.CreateGEP(arrayi32->getElementType(), ArrayLoc, Index, "arrayindex");
-      LValue = ArrayIndex;
+      LValue = Value->ElementPtr(LValue);
     }
 
     RValue = Expr->Codegen();  
@@ -1035,7 +1547,7 @@ public:
     if((LValue->getType()->isIntegerTy(32) == true) &&
        (RValue->getType()->isIntegerTy(1)  == true))
     {  
-      RValue = Builder.CreateZExt(RValue, Builder.getInt32Ty(), "zexttmp");    
+      RValue = Builder->CreateZExt(RValue, Builder->getInt32Ty(), "zexttmp");    
     }
 
     const llvm::PointerType *ptrTy = RValue->getType()->getPointerTo();
@@ -1043,13 +1555,129 @@ public:
     if(LValue->getType() == ptrTy)
     {
       // not clear whether RValue is the address or the actually value stored 
-      val = Builder.CreateStore(RValue, LValue);
+      val = Builder->CreateStore(RValue, LValue);
     }              
     
     debug_print(debug_flag,"...Assign Codegen Ends...");
     return val;
   }
 };
+class MethodCallAST : public decafAST
+{
+  const string &Name;   // owned by symnames
+  int NameId;
+  decafStmtList *ArgList;
+
+public: 
+  MethodCallAST(int nameId, decafStmtList *alist) : Name(symnames.name(nameId)), NameId(nameId), ArgList(alist)
+  {
+    
+  }  
+
+  string str()
+  {
+    return string("MethodCall") + "(" + Name + "," + getString(ArgList) +")"; 
+  }
+  decafAST *Fold(fold_env &env)
+  {
+    if(ArgList != NULL) { ArgList->Fold(env); }
+    return this;
+  }
+  llvm::Value *Codegen() 
+  {
+    // CreateEntryBlockAlloca with the variable_name and type 
+    debug_print(debug_flag, "...MethodCall Codegen Begins...");
+
+    llvm::Value* val = NULL;
+    // a local or field of the same name hides the method
+    llvm::Function* func = llvm::dyn_cast_or_null<llvm::Function>(symtbl.lookup(NameId));
+    if(func == NULL)
+    {
+      throw runtime_error("not a method: " + Name);
+    }
+    list<decafAST*> stmts;
+    vector<llvm::Value*> arg_values;
+    vector<llvm::Type*> arg_types;
+    llvm::Function *call;
+    bool isVoid;
+
+    if(ArgList != NULL)
+    {
+      stmts = ArgList->return_list();
+    }
+    
+    if(func != NULL) 
+    {
+      call = func; 
+      llvm::Function::arg_iterator args = call->arg_begin();   
+      ValueAST *array = NULL; // the array argument just before this one
+   
+      for (list<decafAST*>::iterator i = stmts.begin(); i != stmts.end(); i++, args++)
+      {         
+	llvm::Type*  arg_type  = (*args).getType();
+ 	llvm::Value* arg_value;
+
+        // a whole array is passed as the address of its first element
+        if(arg_type->isPointerTy() && !arg_type->getPointerElementType()->isIntegerTy(8))
+        {
+          array = dynamic_cast<ValueAST*>(*i);
+          if(array == NULL || array->isArray())
+          {
+            throw runtime_error("argument to " + Name + " must be an array name");
+          }
+          arg_value = array->Address();
+          arg_values.push_back(arg_value);
+          continue;
+        }
+
+        arg_value = (*i)->Codegen();  
+
+        // an int after an array, as in read_int_array([]int, int), is
+        // the number of elements the callee touches
+        if(array != NULL && arg_type->isIntegerTy(32))
+        {
+          checkCount(array, *i, arg_value);
+        }
+        array = NULL;
+        
+        if(arg_value->getType()->isIntegerTy(1) && arg_type->isIntegerTy(32))
+	{
+	  arg_value = Builder->CreateZExt(arg_value, Builder->getInt32Ty(), "zexttmp");  
+	}
+        
+        arg_values.push_back(arg_value);    
+      }   
+    }
+
+    isVoid    = call->getReturnType()->isVoidTy();
+    val       = Builder->CreateCall(call, arg_values, isVoid ? "" : "calltmp"); 
+    debug_print(debug_flag, "...MethodCall Codegen Ends...");
+    return val;
+  }
+
+  // checkCount - Count elements of array must exist: a constant count is
+  // checked here, any other one traps at run time with -fbounds-check
+  void checkCount(ValueAST *array, decafAST *countExpr, llvm::Value *Count)
+  {
+    llvm::Value *Array = symtbl.lookup(array->getNameId());
+    uint64_t Length = Array->getType()->getPointerElementType()->getArrayNumElements();
+
+    ConstantAST *c = dynamic_cast<ConstantAST*>(countExpr);
+    if(c != NULL)
+    {
+      if(c->getIntValue() < 0 || (uint64_t)c->getIntValue() > Length)
+      {
+        throw runtime_error(Name + " gets " + to_string(c->getIntValue()) + " elements of "
+                            + symnames.name(array->getNameId()) + ", which has " + to_string(Length));
+      }
+    }
+    else if(boundsCheck)
+    {
+      emitBoundsCheck(Count, Length + 1);
+    }
+  }
+};
+
 
 class IfStmtAST : public decafAST
 {
@@ -1060,12 +1688,6 @@ class IfStmtAST : public decafAST
 public: 
   IfStmtAST(decafAST* condition, BlockAST* if_block, BlockAST* else_block)
            : Condition(condition), IfBlock(if_block), ElseBlock(else_block){} 
-  ~IfStmtAST()
-  {
-    if(Condition != NULL) { delete Condition; }
-    if(IfBlock   != NULL) { delete IfBlock;   }
-    if(ElseBlock != NULL) { delete ElseBlock; }
-  }  
 
   string str()
   {
@@ -1074,53 +1696,151 @@ public:
            getString(IfBlock)   + "," + 
            getString(ElseBlock) + ")";
    }
-  llvm::Value *Codegen() 
+  decafAST *Fold(fold_env &env)
   {
-    llvm::BasicBlock *CurBB = Builder.GetInsertBlock();
-    llvm::Function *func    = CurBB->getParent();
-  
-    llvm::BasicBlock* IfStartBB = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_ifstart", func);
-    llvm::BasicBlock* IfTrueBB  = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_iftrue",  func);
-    llvm::BasicBlock* IfFalseBB = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_iffalse", func);
-    llvm::BasicBlock* IfEndBB   = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_ifend", func);     
+    Condition = foldChild(Condition, env);
 
-    (symtbl.front())["0_ifstart"] = IfStartBB;
-    (symtbl.front())["0_iftrue"]  = IfTrueBB; 
-    (symtbl.front())["0_iffalse"] = IfFalseBB;
-    (symtbl.front())["0_ifend"]   = IfEndBB;
+    // a constant condition keeps only the branch that is taken
+    ConstantAST *c = dynamic_cast<ConstantAST*>(Condition);
+    if(c != NULL)
+    {
+      BlockAST *taken = c->getIntValue() ? IfBlock : ElseBlock;
+      if(taken == IfBlock) { IfBlock   = NULL; }
+      else                 { ElseBlock = NULL; }
 
-    Builder.CreateBr(IfStartBB);
+      if(taken == NULL) { return new decafStmtList(); }
+      taken->Fold(env);
+      return taken;
+    }
 
-    // check if condition is true or false
-    // if true:   Create branch to IfTrueBB
-    // if false:  Create branch to EndBB
+    set<int> names;
+    assignedNames(names);
+
+    fold_env ifEnv = env;
+    IfBlock->Fold(ifEnv);
+    if(ElseBlock != NULL)
+    {
+      fold_env elseEnv = env;
+      ElseBlock->Fold(elseEnv);
+    }
+
+    eraseNames(env, names);
+    return this;
+  }
+  void assignedNames(set<int> &names)
+  {
+    if(IfBlock   != NULL) { IfBlock->assignedNames(names);   }
+    if(ElseBlock != NULL) { ElseBlock->assignedNames(names); }
+  }
+  llvm::Value *Codegen() 
+  {
+    llvm::LLVMContext &C = *TheContext;
+    llvm::Function *func = Builder->GetInsertBlock()->getParent();
+  
+    // the else and end blocks are placed once the blocks before them exist
+    llvm::BasicBlock* IfTrueBB  = llvm::BasicBlock::Create(C, "0_iftrue", func);
+    llvm::BasicBlock* IfFalseBB = ElseBlock != NULL ? llvm::BasicBlock::Create(C, "0_iffalse") : NULL;
+    llvm::BasicBlock* IfEndBB   = llvm::BasicBlock::Create(C, "0_ifend");     
 
-    Builder.SetInsertPoint(IfStartBB);
     llvm::Value* Cond = Condition->Codegen();   
-    
-    Builder.CreateCondBr(Cond, IfTrueBB, IfFalseBB);
+    Builder->CreateCondBr(Cond, IfTrueBB, IfFalseBB != NULL ? IfFalseBB : IfEndBB);
 
-    // Insert instruction to IfTrueBB
-    Builder.SetInsertPoint(IfTrueBB);
+    Builder->SetInsertPoint(IfTrueBB);
     IfBlock->Codegen();
-    Builder.CreateBr(IfEndBB);
+    if(!blockTerminated()) { Builder->CreateBr(IfEndBB); }
 
-    // Insert instruction to IfFalseBB 
-    Builder.SetInsertPoint(IfFalseBB);
-
-    if(ElseBlock != NULL)
+    if(IfFalseBB != NULL)
     {
+      func->getBasicBlockList().push_back(IfFalseBB);
+      Builder->SetInsertPoint(IfFalseBB);
       ElseBlock->Codegen();
+      if(!blockTerminated()) { Builder->CreateBr(IfEndBB); }
     }
-
-    Builder.CreateBr(IfEndBB);
  
-    // Insert instruction to IfEndBB(from MethodAST)
-    Builder.SetInsertPoint(IfEndBB);         
+    // if both arms return, break or continue the if statement does too:
+    // the insert point stays in a terminated block and the statements
+    // after it are skipped
+    if(IfEndBB->use_empty())
+    {
+      delete IfEndBB;
+    }
+    else
+    {
+      func->getBasicBlockList().push_back(IfEndBB);
+      Builder->SetInsertPoint(IfEndBB);         
+    }
     return NULL; 
   }
 };
 
+// loopID - a new self-referencing llvm.loop node that identifies one loop
+// to the loop passes; the vectorizer and unroller record what they did
+// on it and later passes read it back
+static llvm::MDNode *loopID()
+{
+  llvm::LLVMContext &C = *TheContext;
+  llvm::TempMDTuple Temp = llvm::MDNode::getTemporary(C, llvm::None);
+  llvm::Metadata *Ops[] = { Temp.get() };
+  llvm::MDNode *ID = llvm::MDNode::get(C, Ops);
+  ID->replaceOperandWith(0, ID);
+  return ID;
+}
+
+// emitLoop - emit a loop already in rotated, canonical form:
+//
+//   guard:  br Condition, pre, end
+//   pre:    br body
+//   body:   Body; br latch
+//   latch:  Post; br Condition, body, end   (the only back edge, !llvm.loop)
+//   end:
+//
+// so each iteration takes a single conditional branch and the loop passes
+// find a preheader and one latch without having to rotate the loop first
+static void emitLoop(decafAST *Condition, decafAST *Body, decafAST *Post, const string &prefix)
+{
+  llvm::LLVMContext &C = *TheContext;
+  llvm::Function *func = Builder->GetInsertBlock()->getParent();
+
+  llvm::BasicBlock *PreBB   = llvm::BasicBlock::Create(C, prefix + "pre",  func);
+  llvm::BasicBlock *BodyBB  = llvm::BasicBlock::Create(C, prefix + "body", func);
+  // placed after the body's blocks once they have been generated
+  llvm::BasicBlock *LatchBB = llvm::BasicBlock::Create(C, prefix + "latch");
+  llvm::BasicBlock *EndBB   = llvm::BasicBlock::Create(C, prefix + "end");
+
+  symtbl.insert(LOOPLATCH_ID, LatchBB);
+  symtbl.insert(LOOPEND_ID,   EndBB);
+
+  Builder->CreateCondBr(Condition->Codegen(), PreBB, EndBB);
+
+  Builder->SetInsertPoint(PreBB);
+  Builder->CreateBr(BodyBB);
+
+  Builder->SetInsertPoint(BodyBB);
+  Body->Codegen();
+  if(!blockTerminated()) { Builder->CreateBr(LatchBB); }
+
+  // a body that always returns or breaks never reaches the latch
+  if(LatchBB->use_empty())
+  {
+    delete LatchBB;
+  }
+  else
+  {
+    func->getBasicBlockList().push_back(LatchBB);
+    Builder->SetInsertPoint(LatchBB);
+    if(Post != NULL) { Post->Codegen(); }
+    llvm::BranchInst *BackEdge = Builder->CreateCondBr(Condition->Codegen(), BodyBB, EndBB);
+    BackEdge->setMetadata(llvm::LLVMContext::MD_loop, loopID());
+  }
+
+  func->getBasicBlockList().push_back(EndBB);
+  Builder->SetInsertPoint(EndBB);
+
+  // uncover the labels of an enclosing loop
+  symtbl.erase(LOOPLATCH_ID);
+  symtbl.erase(LOOPEND_ID);
+}
+
 class WhileStmt : public decafAST
 {
   decafAST* Condition;  
@@ -1128,69 +1848,52 @@ class WhileStmt : public decafAST
 
 public:
   WhileStmt(decafAST* condition, BlockAST* while_block) : Condition(condition), WhileBlock(while_block){}
-  ~WhileStmt()
-  {
-    if(Condition  != NULL) { delete Condition;  }
-    if(WhileBlock != NULL) { delete WhileBlock; }
-  }
   
   string str()
   { 
     return string("WhileStmt") + "(" + getString(Condition) + "," + getString(WhileBlock) + ")";
   }
-  llvm::Value *Codegen()
-  { 
-    llvm::BasicBlock *CurBB = Builder.GetInsertBlock();
-    llvm::Function *func    = CurBB->getParent();
-  
-    llvm::BasicBlock* WhileStartBB = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_whilestart", func);
-    llvm::BasicBlock* WhileTrueBB  = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_whiletrue",  func);
-    llvm::BasicBlock* WhileEndBB   = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_whileend", func);     
-
-    (symtbl.front())["0_loopstart"] = WhileStartBB;
-    (symtbl.front())["0_looptrue"]  = WhileTrueBB; 
-    (symtbl.front())["0_loopend"]   = WhileEndBB;
-       
-    Builder.CreateBr(WhileStartBB);
-    
-    Builder.SetInsertPoint(WhileStartBB);
-    llvm::Value* Cond = Condition->Codegen(); 
-
-    Builder.CreateCondBr(Cond, WhileTrueBB, WhileEndBB);
-    
-    Builder.SetInsertPoint(WhileTrueBB);
-    WhileBlock->Codegen(); 
-    Builder.CreateBr(WhileStartBB);   
+  decafAST *Fold(fold_env &env)
+  {
+    // anything the body assigns is unknown on every test of the condition
+    set<int> names;
+    assignedNames(names);
+    eraseNames(env, names);
 
-    // Insert instruction to WhileEndBB
-    Builder.SetInsertPoint(WhileEndBB);
-   
-    (symtbl.front()).erase("0_loopstart");
-    (symtbl.front()).erase("0_looptrue") ;
-    (symtbl.front()).erase("0_loopend");
-   
+    Condition = foldChild(Condition, env);
+    ConstantAST *c = dynamic_cast<ConstantAST*>(Condition);
+    if(c != NULL && c->getIntValue() == 0)
+    {
+      return new decafStmtList();
+    }
 
+    fold_env body = env;
+    WhileBlock->Fold(body);
+    return this;
+  }
+  void assignedNames(set<int> &names)
+  {
+    if(WhileBlock != NULL) { WhileBlock->assignedNames(names); }
+  }
+  llvm::Value *Codegen()
+  { 
+    emitLoop(Condition, WhileBlock, NULL, "0_while");
     return NULL; 
   }
 };
 
+bool inductionRange(decafStmtList *pre, decafAST *cond, decafStmtList *post, BlockAST *body, int &nameId, int &lo, int &hi);
+
 class ForStmtAST : public decafAST
 {
-  AssignAST* PreAssign;
-  decafAST*  Condition;
-  AssignAST* PostAssign;
-  BlockAST*  ForBlock;
+  decafStmtList* PreAssign;
+  decafAST*      Condition;
+  decafStmtList* PostAssign;
+  BlockAST*      ForBlock;
     
 public:
-  ForStmtAST(AssignAST* pre_assign, decafAST* condition, AssignAST* post_assign, BlockAST* for_block)
+  ForStmtAST(decafStmtList* pre_assign, decafAST* condition, decafStmtList* post_assign, BlockAST* for_block)
            : PreAssign(pre_assign), Condition(condition), PostAssign(post_assign), ForBlock(for_block){}  
-  ~ForStmtAST()
-  {
-    if(PreAssign  != NULL) { delete PreAssign;  }
-    if(Condition  != NULL) { delete Condition;  }
-    if(PostAssign != NULL) { delete PostAssign; }
-    if(ForBlock   != NULL) { delete ForBlock;   }
-  }
 
   string str()
   { 
@@ -1199,46 +1902,55 @@ public:
                                    + getString(PostAssign) + "," 
                                    + getString(ForBlock)   +  ")";
   }   
-  llvm::Value *Codegen() 
+  decafAST *Fold(fold_env &env)
   {
-    llvm::BasicBlock *CurBB = Builder.GetInsertBlock();
-    llvm::Function *func     = CurBB->getParent();
-    
-    llvm::BasicBlock* ForStartBB = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_forstart", func);
-    llvm::BasicBlock* ForTrueBB  = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_fortrue",  func);
-    llvm::BasicBlock* ForPostBB  = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_forpost",  func);
-    llvm::BasicBlock* ForEndBB   = llvm::BasicBlock::Create(llvm::getGlobalContext(), "0_forend",   func);     
+    PreAssign->Fold(env);
 
-    (symtbl.front())["0_loopstart"]  = ForStartBB;
-    (symtbl.front())["0_looptrue"]   = ForTrueBB; 
-    (symtbl.front())["0_loopassign"] = ForPostBB;
-    (symtbl.front())["0_loopend"]    = ForEndBB;
+    set<int> names;
+    PostAssign->assignedNames(names);
+    ForBlock->assignedNames(names);
+    eraseNames(env, names);
 
-    PreAssign->Codegen();
-    
-    // Condition check
-    Builder.CreateBr(ForStartBB);
-    Builder.SetInsertPoint(ForStartBB);
+    Condition = foldChild(Condition, env);
 
-    llvm::Value* Cond = Condition->Codegen();
-   
-    // Condition branch
-    Builder.CreateCondBr(Cond, ForTrueBB, ForEndBB);
+    fold_env body = env;
+    ForBlock->Fold(body);
+    fold_env post = env;
+    PostAssign->Fold(post);
+    return this;
+  }
+  void assignedNames(set<int> &names)
+  {
+    if(PreAssign  != NULL) { PreAssign->assignedNames(names);  }
+    if(PostAssign != NULL) { PostAssign->assignedNames(names); }
+    if(ForBlock   != NULL) { ForBlock->assignedNames(names);   }
+  }
+  llvm::Value *Codegen() 
+  {
+    PreAssign->Codegen();
 
-    Builder.SetInsertPoint(ForTrueBB);
-    ForBlock->Codegen();
-    Builder.CreateBr(ForPostBB);
-   
-    Builder.SetInsertPoint(ForPostBB); 
-    PostAssign->Codegen();
-    Builder.CreateBr(ForStartBB);
+    // for(i = lo; i < n; i = i + c) over a local i the body does not
+    // assign: array accesses indexed by i in the body need no check
+    int NameId, lo, hi;
+    llvm::Value *Var = NULL;
+    pair<int, int> Outer;
+    bool hadOuter = false;
+    if(boundsCheck && inductionRange(PreAssign, Condition, PostAssign, ForBlock, NameId, lo, hi))
+    {
+      Var = symtbl.lookup(NameId);
+      map<llvm::Value*, pair<int, int> >::iterator i = indexRanges.find(Var);
+      if(i != indexRanges.end()) { Outer = i->second; hadOuter = true; }
+      indexRanges[Var] = make_pair(lo, hi);
+    }
 
-    Builder.SetInsertPoint(ForEndBB);
+    emitLoop(Condition, ForBlock, PostAssign, "0_for");
 
-    //(symtbl.front()).erase("0_loopstart");
-    //(symtbl.front()).erase("0_looptrue") ;
-    //(symtbl.front()).erase("0_loopassign");
-    //(symtbl.front()).erase("0_loopend");
+    if(Var != NULL)
+    {
+      if(hadOuter) { indexRanges[Var] = Outer; }
+      else         { indexRanges.erase(Var);   }
+    }
+    return NULL;
   }
 };
 
@@ -1248,32 +1960,44 @@ class ReturnStmtAST : public decafAST
    
 public: 
   ReturnStmtAST(decafAST* expr) : Expr(expr){}
-  ~ReturnStmtAST()
-  {
-    if(Expr != NULL) { delete Expr;}
-  }
   
   string str()
   {
     return string("ReturnStmt") + "(" + getString(Expr) +")";
   }
+  decafAST *Fold(fold_env &env)
+  {
+    Expr = foldChild(Expr, env);
+    return this;
+  }
   llvm::Value *Codegen() 
   {
-    
-    llvm::Value* val;
-    /*
-    llvm::BasicBlock *CurBB = Builder.GetInsertBlock();
-    llvm::Function *func    = CurBB->getParent();
-    llvm::Type* returnTy    = func->getReturnType();
-    */
+    llvm::Value* val = NULL;
 
     if(Expr != NULL)
     { 
       val = Expr->Codegen();
-      returnValue = val;
-      Builder.CreateRet(returnValue);
-      returnValue = NULL;
+
+      // return f(...) needs nothing of this frame after the call; it can
+      // not be a tail call if it gets the address of a local array
+      llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(val);
+      if(call != NULL)
+      {
+        bool usesFrame = false;
+        for(unsigned int i = 0; i < call->getNumArgOperands(); ++i)
+        {
+          llvm::Value *arg = call->getArgOperand(i);
+          if(arg->getType()->isPointerTy() && !llvm::isa<llvm::Constant>(arg)) { usesFrame = true; }
+        }
+        call->setTailCall(!usesFrame);
+      }
+    }
+    else
+    {
+      // a bare return
+      val = defaultReturn(Builder->GetInsertBlock()->getParent()->getReturnType());
     }
+    Builder->CreateRet(val);
     return val;
   }
 };
@@ -1288,15 +2012,16 @@ public:
   }
   llvm::Value *Codegen() 
   {
-    llvm::BasicBlock* EndBB = (llvm::BasicBlock*)(access_symtbl("0_loopend")); 
+    llvm::BasicBlock* EndBB = (llvm::BasicBlock*)(symtbl.lookup(LOOPEND_ID)); 
     if(EndBB != NULL)
     {
-      Builder.CreateBr(EndBB);
+      Builder->CreateBr(EndBB);
     }   
     else
     {
       throw runtime_error("invalid use of Break statement");
     }   
+    return NULL;
   }
 };
 
@@ -1309,36 +2034,92 @@ public:
   }
   llvm::Value *Codegen() 
   {
-    llvm::BasicBlock* StartBB = (llvm::BasicBlock*)(access_symtbl("0_loopstart")); 
-    if(StartBB != NULL)
+    // continue runs the for loop's update and the test in the latch
+    llvm::BasicBlock* LatchBB = (llvm::BasicBlock*)(symtbl.lookup(LOOPLATCH_ID)); 
+    if(LatchBB != NULL)
     {
-      Builder.CreateBr(StartBB);
+      Builder->CreateBr(LatchBB);
     }   
     else
     {
       throw runtime_error("invalid use of Continue statement");
     }
+    return NULL;
   }
 };
 
 class BinaryExprAST : public decafAST
 {
-  string BinaryOp;
+  decaf_op BinaryOp;
   decafStmtList* LeftValue;
   decafStmtList* RightValue; 
 
 public: 
-  BinaryExprAST(string op, decafStmtList* left, decafStmtList* right) 
+  BinaryExprAST(decaf_op op, decafStmtList* left, decafStmtList* right) 
                : BinaryOp(op), LeftValue(left), RightValue(right){}
-  ~BinaryExprAST()
-   {
-     if(LeftValue != NULL)  { delete LeftValue; }
-     if(RightValue != NULL) { delete RightValue; }
-   }
+
+  decaf_op getOp()    { return BinaryOp; }
+  decafAST *getLeft()  { return (decafAST*)LeftValue;  }
+  decafAST *getRight() { return (decafAST*)RightValue; }
 
   string str()
   {
-    return string("BinaryExpr") + "(" + BinaryOp + "," + getString(LeftValue) + "," + getString(RightValue) + ")";
+    return string("BinaryExpr") + "(" + op_table[BinaryOp].name + "," + getString(LeftValue) + "," + getString(RightValue) + ")";
+  }
+  decafAST *Fold(fold_env &env)
+  {
+    LeftValue  = (decafStmtList*)foldChild(LeftValue,  env);
+    RightValue = (decafStmtList*)foldChild(RightValue, env);
+
+    ConstantAST *L = dynamic_cast<ConstantAST*>((decafAST*)LeftValue);
+    ConstantAST *R = dynamic_cast<ConstantAST*>((decafAST*)RightValue);
+
+    // a constant left operand decides && and || on its own
+    if(L != NULL && (BinaryOp == OP_AND || BinaryOp == OP_OR))
+    {
+      bool l = (L->getIntValue() != 0);
+      if(l == (BinaryOp == OP_OR)) { return new ConstantAST(TY_BOOL, l ? 1 : 0); }
+      decafAST *e = RightValue;
+      RightValue = NULL;
+      return e;
+    }
+
+    if(L == NULL || R == NULL) { return this; }
+
+    // 32 bit wrap around arithmetic, left to run time when it would trap
+    // or be undefined in the IR
+    unsigned int l = (unsigned int)L->getIntValue();
+    unsigned int r = (unsigned int)R->getIntValue();
+    int sl = L->getIntValue();
+    int sr = R->getIntValue();
+    switch(BinaryOp)
+    {
+      case OP_PLUS:  return new ConstantAST(TY_INT, (int)(l + r));
+      case OP_MINUS: return new ConstantAST(TY_INT, (int)(l - r));
+      case OP_MULT:  return new ConstantAST(TY_INT, (int)(l * r));
+      case OP_DIV:
+      case OP_MOD:
+      {
+        if(sr == 0 || (sl == INT_MIN && sr == -1)) { return this; }
+        return new ConstantAST(TY_INT, BinaryOp == OP_DIV ? sl / sr : sl % sr);
+      }
+      case OP_LEFTSHIFT:
+      case OP_RIGHTSHIFT:
+      {
+        if(r >= 32) { return this; }
+        return new ConstantAST(TY_INT, (int)(BinaryOp == OP_LEFTSHIFT ? l << r : l >> r));
+      }
+      case OP_EQ:  return new ConstantAST(TY_BOOL, sl == sr ? 1 : 0);
+      case OP_NEQ: return new ConstantAST(TY_BOOL, sl != sr ? 1 : 0);
+      case OP_LT:  return new ConstantAST(TY_BOOL, sl <  sr ? 1 : 0);
+      case OP_GT:  return new ConstantAST(TY_BOOL, sl >  sr ? 1 : 0);
+      case OP_LEQ: return new ConstantAST(TY_BOOL, sl <= sr ? 1 : 0);
+      case OP_GEQ: return new ConstantAST(TY_BOOL, sl >= sr ? 1 : 0);
+      case OP_AND: return new ConstantAST(TY_BOOL, (sl && sr) ? 1 : 0);
+      case OP_OR:  return new ConstantAST(TY_BOOL, (sl || sr) ? 1 : 0);
+      default: break;
+    }
+    return this;
   }
   llvm::Value *Codegen() 
   { 
@@ -1347,137 +2128,45 @@ public:
     llvm::Value* val = nullptr;
     llvm::Value* LValue;
     llvm::Value* RValue;
+    const op_info &Op = op_table[BinaryOp];
 
-    llvm::BasicBlock *CurBB;
-    llvm::BasicBlock* RBB;
-    llvm::Function *func;
-    llvm::BasicBlock* MergeBB;
-    llvm::PHINode* phi;
-
-    int CurOp = getOperator(BinaryOp);
-    if((CurOp != T_AND) && (CurOp != T_OR))
+    if(Op.kind == OPK_LOGIC)
     {
+      // control flow basic blocks for boolean short circuiting 
+      llvm::BasicBlock *CurBB   = Builder->GetInsertBlock();
+      llvm::Function   *func    = CurBB->getParent();
+      llvm::BasicBlock *RBB     = llvm::BasicBlock::Create(*TheContext, "rval", func); 
+      llvm::BasicBlock *MergeBB = llvm::BasicBlock::Create(*TheContext, "merge", func); 
+
+      // && only looks at the right side when the left is true, || when it is false
       LValue = LeftValue->Codegen();
+      CurBB  = Builder->GetInsertBlock();
+      if(BinaryOp == OP_AND) { Builder->CreateCondBr(LValue, RBB, MergeBB); }
+      else                   { Builder->CreateCondBr(LValue, MergeBB, RBB); }
+
+      Builder->SetInsertPoint(RBB);
       RValue = RightValue->Codegen();
+      RBB    = Builder->GetInsertBlock(); // update the current block 
+      Builder->CreateBr(MergeBB);        
+
+      Builder->SetInsertPoint(MergeBB);                     
+      llvm::PHINode *phi = Builder->CreatePHI(LValue->getType(), 2, Op.tmpname); 
+      phi->addIncoming(LValue, CurBB);
+      phi->addIncoming(RValue, RBB);
+      val = (llvm::Value*)phi;
     }
     else
     {
-      // control flow basic blocks for boolean short circuiting 
-      CurBB   = Builder.GetInsertBlock();
-      func    = CurBB->getParent();
-      RBB     = llvm::BasicBlock::Create(llvm::getGlobalContext(), "rval", func); 
-      MergeBB = llvm::BasicBlock::Create(llvm::getGlobalContext(), "merge", func); 
-    }  
-
-    switch(getOperator(BinaryOp))
-    {  
-      case T_AND: 
-      {
-        //Builder.CreateBr(LBB);
-        //Builder.SetInsertPoint(LBB);
-        LValue = LeftValue->Codegen();
-        Builder.CreateCondBr(LValue, RBB, MergeBB);
-
-        Builder.SetInsertPoint(RBB);
-        RValue = RightValue->Codegen();
-        RBB    = Builder.GetInsertBlock(); // update the current block 
-        Builder.CreateBr(MergeBB);        
- 
-        Builder.SetInsertPoint(MergeBB);                     
- 	phi = Builder.CreatePHI(LValue->getType(), 2, "phival"); 
-        phi->addIncoming(LValue, CurBB);
-        phi->addIncoming(RValue, RBB);
-  
-        val = (llvm::Value*)phi;
-        break;
-      }
-      case T_OR:
-      {
-        //Builder.CreateBr(LBB);
-        //Builder.SetInsertPoint(LBB);
-        LValue = LeftValue->Codegen();
-        Builder.CreateCondBr(LValue, MergeBB, RBB);
-
-        Builder.SetInsertPoint(RBB);
-        RValue = RightValue->Codegen();
-        RBB    = Builder.GetInsertBlock(); // update the current block 
-        Builder.CreateBr(MergeBB);        
-         
-        Builder.SetInsertPoint(MergeBB);                     
- 	phi = Builder.CreatePHI(LValue->getType(), 2, "phival"); 
-        phi->addIncoming(LValue, CurBB);
-        phi->addIncoming(RValue, RBB);
-        
-        val = (llvm::Value*)phi;
-        break;
-      }
- 
-      case T_PLUS: 
-      {  
-        val = Builder.CreateAdd(LValue,RValue,"addtmp");
-        break;
-      }
-      case T_MINUS: 
-      {  
-        val = Builder.CreateSub(LValue,RValue,"subtmp");
-        break;
-      }
-      case T_MULT: 
-      {  
-        val = Builder.CreateMul(LValue,RValue,"multmp");
-        break;
-      }
-      case T_DIV: 
-      {  
-        val = Builder.CreateSDiv(LValue,RValue,"divtmp");
-        break;
-      }
-      case T_LEFTSHIFT:
-      {
-        val = Builder.CreateShl(LValue, RValue,"lstmp");
-        break;
-      }
-      case T_RIGHTSHIFT:
-      {
-        val = Builder.CreateLShr(LValue, RValue,"rstmp");
-        break;
-      }
-      case T_MOD:
-      {
-        val = Builder.CreateSRem(LValue, RValue,"modtmp");
-        break;
-      }
-      case T_EQ:
-      {
-        val = Builder.CreateICmpEQ(LValue, RValue,"eqtmp");
-        break;
-      }
-      case T_NEQ:
-      {
-        val = Builder.CreateICmpNE(LValue, RValue,"neqtmp");
-        break;
-      }
-      case T_LT:
-      {
-        val = Builder.CreateICmpSLT(LValue, RValue,"lttmp");        
-        break;
-      }
-      case T_GT:
-      {
-        val = Builder.CreateICmpSGT(LValue, RValue,"gttmp");
-        break;
-      }
-      case T_LEQ:
+      LValue = LeftValue->Codegen();
+      RValue = RightValue->Codegen();
+      if(Op.kind == OPK_ARITH)
       {
-        val = Builder.CreateICmpSLE(LValue, RValue,"leqtmp");
-        break;
+        val = Builder->CreateBinOp(Op.opcode, LValue, RValue, Op.tmpname);
       }
-      case T_GEQ:
+      else
       {
-        val = Builder.CreateICmpSGE(LValue, RValue,"geqtmp");
-        break;
+        val = Builder->CreateICmp(Op.pred, LValue, RValue, Op.tmpname);
       }
-      default: break;
     }
     debug_print(debug_flag, "...BinaryOp Codegen Ends...");
     return val;
@@ -1486,19 +2175,35 @@ public:
 
 class UnaryExprAST : public decafAST
 {
-  string UnaryOp;
+  decaf_op UnaryOp;
   decafStmtList* RightValue; 
 
 public: 
-  UnaryExprAST(string op,  decafStmtList* right) : UnaryOp(op), RightValue(right){}
-  ~UnaryExprAST()
-   {
-     if(RightValue != NULL) { delete RightValue; }
-   }
+  UnaryExprAST(decaf_op op,  decafStmtList* right) : UnaryOp(op), RightValue(right){}
 
   string str()
   {
-    return string("UnaryExpr") + "(" + UnaryOp + "," + getString(RightValue) + ")";
+    return string("UnaryExpr") + "(" + op_table[UnaryOp].name + "," + getString(RightValue) + ")";
+  }
+  decafAST *Fold(fold_env &env)
+  {
+    RightValue = (decafStmtList*)foldChild(RightValue, env);
+
+    ConstantAST *R = dynamic_cast<ConstantAST*>((decafAST*)RightValue);
+    if(R == NULL) { return this; }
+
+    int r = R->getIntValue();
+    switch(UnaryOp)
+    {
+      case OP_NOT:
+      {
+        if(R->getType() == TY_BOOL) { return new ConstantAST(TY_BOOL, r ? 0 : 1); }
+        return new ConstantAST(TY_INT, ~r);
+      }
+      case OP_UNARYMINUS: return new ConstantAST(TY_INT, (int)(0u - (unsigned int)r));
+      default: break;
+    }
+    return this;
   }
   llvm::Value *Codegen() 
   {
@@ -1506,21 +2211,513 @@ public:
     llvm::Value* val = NULL;
     llvm::Value* RValue = RightValue->Codegen();
     
-    switch(getOperator(UnaryOp))
+    if(UnaryOp == OP_NOT)
     {
-      case T_NOT:
-      {
-        val = Builder.CreateNot(RValue,"unottmp");
-        break;
-      }
-      case T_MINUS:
-      {
-        val = Builder.CreateNeg(RValue,"unegtmp");
-        break;
-      }
-      default: break;
+      val = Builder->CreateNot(RValue, op_table[UnaryOp].tmpname);
+    }
+    else
+    {
+      val = Builder->CreateNeg(RValue, op_table[UnaryOp].tmpname);
     }
     debug_print(debug_flag, "...UnaryOp Codegen Ends...");
     return val;
   }
 };
+
+// singleAssign - the assignment of an assign list holding exactly one
+static AssignAST *singleAssign(decafStmtList *assigns)
+{
+  if(assigns == NULL || assigns->size() != 1) { return NULL; }
+  return dynamic_cast<AssignAST*>(assigns->front());
+}
+
+// inductionRange - recognize for(i = lo; i < K; i = i + c) (or i <= K)
+// with constant lo, K and c > 0 where the body never assigns i, and
+// return the range [lo, hi] i stays in while the body runs. The step
+// must not overflow on the last test or i could wrap back into the loop.
+// Only a single local i qualifies: a global can be assigned by any
+// method the body calls.
+bool inductionRange(decafStmtList *preList, decafAST *cond, decafStmtList *postList, BlockAST *body, int &nameId, int &lo, int &hi)
+{
+  AssignAST *pre  = singleAssign(preList);
+  AssignAST *post = singleAssign(postList);
+  if(pre == NULL || cond == NULL || post == NULL || body == NULL) { return false; }
+  if(pre->getValue()->isArray() || post->getValue()->isArray()) { return false; }
+
+  nameId = pre->getValue()->getNameId();
+  if(post->getValue()->getNameId() != nameId) { return false; }
+  llvm::Value *var = symtbl.lookup(nameId);
+  if(var == NULL || !llvm::isa<llvm::AllocaInst>(var)) { return false; }
+
+  ConstantAST *start = dynamic_cast<ConstantAST*>(pre->getExpr());
+  if(start == NULL || start->getType() != TY_INT) { return false; }
+
+  // i < K or i <= K
+  BinaryExprAST *test = dynamic_cast<BinaryExprAST*>(cond);
+  if(test == NULL || (test->getOp() != OP_LT && test->getOp() != OP_LEQ)) { return false; }
+  ValueAST *tv = dynamic_cast<ValueAST*>(test->getLeft());
+  ConstantAST *limit = dynamic_cast<ConstantAST*>(test->getRight());
+  if(tv == NULL || tv->isArray() || tv->getNameId() != nameId || limit == NULL) { return false; }
+
+  // i = i + c or i = c + i
+  BinaryExprAST *step = dynamic_cast<BinaryExprAST*>(post->getExpr());
+  if(step == NULL || step->getOp() != OP_PLUS) { return false; }
+  ValueAST *sv = dynamic_cast<ValueAST*>(step->getLeft());
+  ConstantAST *inc = dynamic_cast<ConstantAST*>(step->getRight());
+  if(sv == NULL)
+  {
+    sv  = dynamic_cast<ValueAST*>(step->getRight());
+    inc = dynamic_cast<ConstantAST*>(step->getLeft());
+  }
+  if(sv == NULL || sv->isArray() || sv->getNameId() != nameId || inc == NULL || inc->getIntValue() <= 0) { return false; }
+
+  set<int> names;
+  body->assignedNames(names);
+  if(names.count(nameId) != 0) { return false; }
+
+  long long last = (long long)limit->getIntValue() - (test->getOp() == OP_LT ? 1 : 0);
+  if(last + inc->getIntValue() > INT_MAX) { return false; }
+
+  lo = start->getIntValue();
+  hi = (int)last;
+  return lo <= hi;
+}
+
+// isOptimizationRemark - the diagnostic kinds that are a
+// DiagnosticInfoOptimizationBase
+bool isOptimizationRemark(const llvm::DiagnosticInfo &DI)
+{
+  switch(DI.getKind())
+  {
+    case llvm::DK_OptimizationRemark:
+    case llvm::DK_OptimizationRemarkMissed:
+    case llvm::DK_OptimizationRemarkAnalysis:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// reportDiagnostic - diagnostic handler of the optimization pipeline. With
+// -inline-report the inliner's remarks (inlined, not inlined and why) go
+// to stderr as IR comments, other remarks are dropped. Other diagnostics
+// are printed as usual; an error sets the bool Context points at, so it
+// fails only the file being compiled, not the whole batch.
+void reportDiagnostic(const llvm::DiagnosticInfo &DI, void *Context)
+{
+  if(DI.getSeverity() == llvm::DS_Remark)
+  {
+    if(inlineReport && isOptimizationRemark(DI))
+    {
+      const llvm::DiagnosticInfoOptimizationBase &R = (const llvm::DiagnosticInfoOptimizationBase &)DI;
+      if(string(R.getPassName()) == "inline")
+      {
+        cerr << "; inline: " << R.getMsg().str() << endl;
+      }
+    }
+    return;
+  }
+
+  llvm::DiagnosticPrinterRawOStream DP(llvm::errs());
+  DI.print(DP);
+  llvm::errs() << "\n";
+  if(DI.getSeverity() == llvm::DS_Error) { *(bool *)Context = true; }
+}
+
+// optimizeModule - run the module and function pass pipeline for the given
+// -O level over TheModule; level 0 only inlines methods marked inline
+void optimizeModule(unsigned int level)
+{
+  if(level == 0) 
+  { 
+    llvm::legacy::PassManager MPM;
+    MPM.add(llvm::createAlwaysInlinerPass());
+    MPM.run(*TheModule);
+    return; 
+  }
+
+  llvm::PassManagerBuilder PMB;
+  PMB.OptLevel  = level;
+  PMB.SizeLevel = 0;
+
+  // instcombine, gvn, simplifycfg, licm and the loop passes all come from
+  // the builder; the cost model inliner is added from -O2 upwards, or at
+  // any level when -finline-threshold sets its threshold
+  if(inlineThreshold >= 0)
+  {
+    PMB.Inliner = llvm::createFunctionInliningPass(inlineThreshold);
+  }
+  else if(level >= 2)
+  {
+    PMB.Inliner = llvm::createFunctionInliningPass(level, 0);
+  }
+  else
+  {
+    PMB.Inliner = llvm::createAlwaysInlinerPass();
+  }
+  PMB.LoopVectorize = (level >= 2);
+  PMB.SLPVectorize  = (level >= 3);
+
+  llvm::legacy::FunctionPassManager FPM(TheModule);
+  llvm::legacy::PassManager MPM;
+  PMB.populateFunctionPassManager(FPM);
+  PMB.populateModulePassManager(MPM);
+
+  FPM.doInitialization();
+  for(llvm::Module::iterator f = TheModule->begin(); f != TheModule->end(); ++f)
+  {
+    if(!f->isDeclaration()) { FPM.run(*f); }
+  }
+  FPM.doFinalization();
+
+  MPM.run(*TheModule);
+}
+
+// createHostTargetMachine - set up a TargetMachine for the host and make
+// TheModule use its triple and data layout; jit selects the code model
+// MCJIT expects
+llvm::TargetMachine* createHostTargetMachine(unsigned int level, bool jit)
+{
+  string triple = llvm::sys::getDefaultTargetTriple();
+  string error;
+  const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+  if(target == NULL)
+  {
+    throw runtime_error("no target for " + triple + ": " + error);
+  }
+
+  llvm::CodeGenOpt::Level cgLevel = llvm::CodeGenOpt::Default;
+  if(level == 0)      { cgLevel = llvm::CodeGenOpt::None; }
+  else if(level == 1) { cgLevel = llvm::CodeGenOpt::Less; }
+  else if(level == 3) { cgLevel = llvm::CodeGenOpt::Aggressive; }
+
+  llvm::TargetOptions options;
+  llvm::TargetMachine *TM = target->createTargetMachine(triple, 
+                                                        llvm::sys::getHostCPUName(), 
+                                                        "", 
+                                                        options, 
+                                                        llvm::Reloc::PIC_, 
+                                                        jit ? llvm::CodeModel::JITDefault : llvm::CodeModel::Default, 
+                                                        cgLevel);
+  if(TM == NULL)
+  {
+    throw runtime_error("could not create a target machine for " + triple);
+  }
+
+  TheModule->setTargetTriple(triple);
+  TheModule->setDataLayout(TM->createDataLayout());
+  return TM;
+}
+
+// emitNativeFile - lower TheModule to an object file, or to assembly when
+// assembly is true, and write it to filename
+void emitNativeFile(llvm::TargetMachine *TM, string filename, bool assembly)
+{
+  std::error_code EC;
+  llvm::raw_fd_ostream dest(filename, EC, llvm::sys::fs::F_None);
+  if(EC)
+  {
+    throw runtime_error("could not open " + filename + ": " + EC.message());
+  }
+
+  llvm::TargetMachine::CodeGenFileType type = assembly ? llvm::TargetMachine::CGFT_AssemblyFile 
+                                                       : llvm::TargetMachine::CGFT_ObjectFile;
+  llvm::legacy::PassManager PM;
+  if(TM->addPassesToEmitFile(PM, dest, type))
+  {
+    throw runtime_error("the target cannot emit this file type");
+  }
+
+  PM.run(*TheModule);
+  dest.flush();
+}
+
+// emitModule - write TheModule as textual IR, or as bitcode when bitcode is
+// true, through a buffered stream; "-" is stdout
+void emitModule(string filename, bool bitcode)
+{
+  std::error_code EC;
+  llvm::raw_fd_ostream out(filename, EC, bitcode ? llvm::sys::fs::F_None : llvm::sys::fs::F_Text);
+  if(EC)
+  {
+    throw runtime_error("could not open " + filename + ": " + EC.message());
+  }
+
+  if(bitcode)
+  {
+    llvm::WriteBitcodeToFile(TheModule, out);
+  }
+  else
+  {
+    TheModule->print(out, NULL);
+  }
+  out.flush();
+}
+
+// emitBuffer - the output of the given kind in memory, for the compilation
+// cache; native kinds need TM
+string emitBuffer(llvm::TargetMachine *TM, const string &kind)
+{
+  llvm::SmallVector<char, 0> buf;
+  llvm::raw_svector_ostream out(buf);
+
+  if(kind == "obj" || kind == "asm")
+  {
+    llvm::TargetMachine::CodeGenFileType type = kind == "asm" ? llvm::TargetMachine::CGFT_AssemblyFile 
+                                                              : llvm::TargetMachine::CGFT_ObjectFile;
+    llvm::legacy::PassManager PM;
+    if(TM->addPassesToEmitFile(PM, out, type))
+    {
+      throw runtime_error("the target cannot emit this file type");
+    }
+    PM.run(*TheModule);
+  }
+  else if(kind == "bc")
+  {
+    llvm::WriteBitcodeToFile(TheModule, out);
+  }
+  else
+  {
+    TheModule->print(out, NULL);
+  }
+  return string(buf.data(), buf.size());
+}
+
+// writeOutput - write bytes to filename, "-" is stdout and "" stderr
+void writeOutput(const string &filename, const string &bytes)
+{
+  if(filename.empty())
+  {
+    llvm::raw_fd_ostream err(STDERR_FILENO, false);
+    err << bytes;
+    return;
+  }
+
+  std::error_code EC;
+  llvm::raw_fd_ostream file(filename, EC, llvm::sys::fs::F_None);
+  if(EC)
+  {
+    throw runtime_error("could not open " + filename + ": " + EC.message());
+  }
+  file << bytes;
+  file.flush();
+}
+
+// Compilation cache (--cache)
+//
+// An entry is a file in cacheDir named after the MD5 of the compiler
+// build, the options that change the output and the source. It holds the
+// package name on its first line, for the default output name, and then
+// the output. A hit touches the entry, so when the directory grows past
+// cacheLimit, deleting the oldest entries first drops the least recently
+// used ones. Two compilers writing the same entry is harmless: entries are
+// written to a temporary file and renamed into place.
+//
+// The directory is only scanned when it is full: cacheDir/.size keeps a
+// running total of the bytes stored, updated under flock, and an eviction
+// scan deletes entries down to 90% of cacheLimit and writes the real total
+// back. Overwritten entries make the running total too high, which only
+// brings the next scan forward.
+
+// cacheSize - add added bytes to the running total in cacheDir/.size, or
+// set it to total when set is true; returns the new total, or ULLONG_MAX
+// when the stamp cannot be used, which forces a scan
+unsigned long long cacheSize(unsigned long long added, bool set)
+{
+  int fd = open((cacheDir + "/.size").c_str(), O_RDWR | O_CREAT, 0644);
+  if(fd < 0) { return ULLONG_MAX; }
+  if(flock(fd, LOCK_EX) != 0)
+  {
+    close(fd);
+    return ULLONG_MAX;
+  }
+
+  char buf[32];
+  ssize_t got = read(fd, buf, sizeof(buf) - 1);
+  buf[got > 0 ? got : 0] = '\0';
+  unsigned long long total = set ? added : strtoull(buf, NULL, 10) + added;
+
+  int len = snprintf(buf, sizeof(buf), "%llu\n", total);
+  bool ok = lseek(fd, 0, SEEK_SET) == 0 && ftruncate(fd, 0) == 0 && write(fd, buf, len) == len;
+  close(fd);
+  return ok ? total : ULLONG_MAX;
+}
+
+// identifies the build of the compiler, a rebuild starts a new cache
+static const char *COMPILER_BUILD = "decafcomp " __DATE__ " " __TIME__ " llvm " LLVM_VERSION_STRING;
+
+// readSource - the whole program, from stdin when input is empty
+bool readSource(const string &input, string &source)
+{
+  FILE *in = input.empty() ? stdin : fopen(input.c_str(), "r");
+  if(in == NULL) { return false; }
+
+  char buf[1 << 16];
+  size_t got;
+  while((got = fread(buf, 1, sizeof(buf), in)) > 0)
+  {
+    source.append(buf, got);
+  }
+  bool ok = !ferror(in);
+  if(in != stdin) { fclose(in); }
+  return ok;
+}
+
+// cacheKey - hex MD5 of everything that determines the output for source
+string cacheKey(const string &source)
+{
+  ostringstream options;
+  options << "-O" << optLevel << " mem2reg=" << promoteLocals << " fold=" << foldConstants
+          << " bounds=" << boundsCheck << " inline=" << inlineThreshold << " kind=" << outputKind
+          << " target=" << llvm::sys::getDefaultTargetTriple() << " cpu=" << string(llvm::sys::getHostCPUName());
+
+  llvm::MD5 hash;
+  hash.update(llvm::StringRef(COMPILER_BUILD, strlen(COMPILER_BUILD) + 1));
+  hash.update(llvm::StringRef(options.str().c_str(), options.str().size() + 1));
+  hash.update(source);
+
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> hex;
+  llvm::MD5::stringifyResult(result, hex);
+  return hex.str().str();
+}
+
+// cacheLoad - look up key; on a hit fill in the package name and output
+bool cacheLoad(const string &key, string &moduleId, string &bytes)
+{
+  string path = cacheDir + "/" + key;
+  string entry;
+  if(!readSource(path, entry)) { return false; }
+
+  size_t newline = entry.find('\n');
+  if(newline == string::npos) { return false; }
+  moduleId = entry.substr(0, newline);
+  bytes    = entry.substr(newline + 1);
+
+  // most recently used
+  utime(path.c_str(), NULL);
+  return true;
+}
+
+// cacheEvict - delete the least recently used entries until the cache is
+// within 90% of cacheLimit
+void cacheEvict()
+{
+  DIR *dir = opendir(cacheDir.c_str());
+  if(dir == NULL) { return; }
+
+  vector<pair<time_t, string> > entries;
+  map<string, off_t> sizes;
+  unsigned long long total = 0;
+  struct dirent *de;
+  while((de = readdir(dir)) != NULL)
+  {
+    string name = de->d_name;
+    struct stat st;
+    // skip . and .. and the entries other compilers are writing
+    if(name[0] == '.' || name.find(".tmp") != string::npos) { continue; }
+    if(stat((cacheDir + "/" + name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) { continue; }
+    entries.push_back(make_pair(st.st_mtime, name));
+    sizes[name] = st.st_size;
+    total += st.st_size;
+  }
+  closedir(dir);
+
+  // evict below the limit, so the next scan is some stores away
+  unsigned long long target = cacheLimit / 10 * 9;
+  sort(entries.begin(), entries.end());
+  for(size_t i = 0; i < entries.size() && total > target; ++i)
+  {
+    if(unlink((cacheDir + "/" + entries[i].second).c_str()) == 0)
+    {
+      total -= sizes[entries[i].second];
+    }
+  }
+  cacheSize(total, true);
+}
+
+// cacheStore - add the output for key; failures only cost a later miss
+void cacheStore(const string &key, const string &moduleId, const string &bytes)
+{
+  ostringstream tmp;
+  tmp << cacheDir << "/" << key << ".tmp" << getpid() << "." << std::hash<std::thread::id>()(this_thread::get_id());
+
+  FILE *out = fopen(tmp.str().c_str(), "w");
+  if(out == NULL) { return; }
+  bool ok = fprintf(out, "%s\n", moduleId.c_str()) >= 0 && 
+            fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+  ok = (fclose(out) == 0) && ok;
+  if(!ok || rename(tmp.str().c_str(), (cacheDir + "/" + key).c_str()) != 0)
+  {
+    unlink(tmp.str().c_str());
+    return;
+  }
+  if(cacheSize(moduleId.size() + 1 + bytes.size(), false) > cacheLimit)
+  {
+    cacheEvict();
+  }
+}
+
+// registerRuntime - bind the runtime functions to the copies linked into
+// decafcomp, once per process; the compile server does it at startup so
+// its jobs inherit the bindings
+void registerRuntime()
+{
+  static bool registered = false;
+  if(registered) { return; }
+  registered = true;
+
+  llvm::sys::DynamicLibrary::AddSymbol("print_int",    (void*)&print_int);
+  llvm::sys::DynamicLibrary::AddSymbol("print_string", (void*)&print_string);
+  llvm::sys::DynamicLibrary::AddSymbol("read_int",     (void*)&read_int);
+  llvm::sys::DynamicLibrary::AddSymbol("read_int_array",  (void*)&read_int_array);
+  llvm::sys::DynamicLibrary::AddSymbol("print_int_array", (void*)&print_int_array);
+}
+
+// runModule - JIT compile TheModule with MCJIT and call the package's main;
+// the execution engine takes over both TM and TheModule
+int runModule(llvm::TargetMachine *TM)
+{
+  registerRuntime();
+
+  llvm::Function *mainFunc = TheModule->getFunction("main");
+  if(mainFunc == NULL || mainFunc->isDeclaration())
+  {
+    throw runtime_error("no main method in package " + TheModule->getModuleIdentifier());
+  }
+  llvm::Type *returnTy = mainFunc->getReturnType();
+
+  string error;
+  llvm::ExecutionEngine *EE = llvm::EngineBuilder(std::unique_ptr<llvm::Module>(TheModule))
+                                .setEngineKind(llvm::EngineKind::JIT)
+                                .setErrorStr(&error)
+                                .create(TM);
+  if(EE == NULL)
+  {
+    throw runtime_error("could not create the JIT: " + error);
+  }
+  TheModule = NULL;
+
+  EE->finalizeObject();
+  uint64_t addr = EE->getFunctionAddress("main");
+
+  int result = 0;
+  if(returnTy->isVoidTy())
+  {
+    ((void (*)())addr)();
+  }
+  else if(returnTy->isIntegerTy(1))
+  {
+    result = ((bool (*)())addr)() ? 1 : 0;
+  }
+  else
+  {
+    result = ((int (*)())addr)();
+  }
+  // the runtime buffers its output
+  decaf_flush();
+
+  delete EE;
+  return result;
+}
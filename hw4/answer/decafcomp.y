@@ -5,35 +5,98 @@
 #include <cstdlib>
 #include "decafcomp-defs.h"
 
-int yylex(void);
-int yyerror(char *); 
 
 // print AST?
 bool printAST = false;
 
+// promote locals and parameters to SSA registers (mem2reg)?
+bool promoteLocals = true;
+
+// fold constant expressions in the AST before Codegen?
+bool foldConstants = true;
+
+// guard array accesses with a bounds check (-fbounds-check)?
+bool boundsCheck = false;
+
+// optimization level (-O0 to -O3)
+unsigned int optLevel = 0;
+
+// threshold of the cost model inliner, -1 for the -O level's default
+// (-finline-threshold=N)
+int inlineThreshold = -1;
+
+// report what the inliner did (-inline-report)?
+bool inlineReport = false;
+
+// per phase timing report: "" (off), "text" or "json" (--time-report[=json])
+string timeReportKind = "";
+
+// report the time spent in the optimization pipeline?
+bool printOptTime = false;
+
+// output kind: "llvm" (-emit-llvm, the default), "bc" (-emit-bc),
+// "obj" (-c) or "asm" (-S)
+string outputKind = "llvm";
+
+// output file name (-o)
+string outputFile = "";
+
+// JIT compile and run the program instead of writing it out (--run)
+bool runProgram = false;
+
+// source file, stdin when empty
+string inputFile = "";
+
+// compilation cache directory, no caching when empty
+// (--cache[=DIR] or the DECAFCOMP_CACHE environment variable)
+string cacheDir = "";
+
+// size limit of the compilation cache in bytes (--cache-size=MB)
+unsigned long long cacheLimit = 256ULL << 20;
+
 using namespace std;
 // this global variable contains all the generated code
-static llvm::Module *TheModule;
+static thread_local llvm::Module *TheModule;
 
-// this is the method used to construct the LLVM intermediate code (IR)
-static llvm::IRBuilder<> Builder(llvm::getGlobalContext());
-// the calls to getGlobalContext() in the init above and in the
-// following code ensures that we are incrementally generating
-// instructions in the right order
+// every compileFile call makes its own context, so jobs share no types,
+// constants or metadata, and a long running thread or server does not
+// keep the uniqued types and constants of all the files it compiled
+static thread_local llvm::LLVMContext *TheContext = NULL;
+
+// this is the method used to construct the LLVM intermediate code (IR);
+// it belongs to the context of the current compileFile call
+static thread_local llvm::IRBuilder<> *Builder = NULL;
+
+// per function passes run as soon as each method has been generated
+static thread_local llvm::legacy::FunctionPassManager *TheFPM = NULL;
 
 
 #include "decafcomp.cc"
 %}
 
+/* a pure parser: the parse state is in the parse_context of the caller */
+%define api.pure full
+%parse-param { parse_context *ctx }
+%lex-param { parse_context *ctx }
+
 %union
 {
   class decafAST *ast;
-  std::string *sval;
-  std::deque<string> *deque_ptr;
+  int sym;                    // symnames id of an identifier, literals id of a literal
+  id_list *deque_ptr;
   int ival;
+  decaf_op op;
+  decaf_type type;
+  inline_hint hint;
   array_info arrinfo;
 }
 
+%code
+{
+int yylex(YYSTYPE *, parse_context *);
+int yyerror(parse_context *, const char *);
+}
+
 %token T_FUNC
 x%token T_PACKAGE
 %token T_VAR
@@ -45,8 +108,8 @@ x%token T_PACKAGE
 %token T_BREAK 
 %token T_CONTINUE 
 %token T_EXTERN 
-%token <sval> T_TRUE
-%token <sval> T_FALSE
+%token T_TRUE
+%token T_FALSE
 %token T_IF 
 %token T_ELSE
 %token T_FOR 
@@ -62,31 +125,31 @@ x%token T_PACKAGE
 %token T_COMMA
 %token T_SEMICOLON
 
-%token <sval> T_EQ
-%token <sval> T_LEQ
-%token <sval> T_GEQ
-%token <sval> T_NEQ
-%token <sval> T_LEFTSHIFT
-%token <sval> T_RIGHTSHIFT
-%token <sval> T_AND
-%token <sval> T_OR
-
-%token <sval> T_PLUS
-%token <sval> T_MINUS
-%token <sval> T_MULT
-%token <sval> T_DIV
-%token <sval> T_NOT
+%token <op> T_EQ
+%token <op> T_LEQ
+%token <op> T_GEQ
+%token <op> T_NEQ
+%token <op> T_LEFTSHIFT
+%token <op> T_RIGHTSHIFT
+%token <op> T_AND
+%token <op> T_OR
+
+%token <op> T_PLUS
+%token <op> T_MINUS
+%token <op> T_MULT
+%token <op> T_DIV
+%token <op> T_NOT
 %token T_ASSIGN
-%token <sval> T_LT
-%token <sval> T_GT
-%token <sval> T_MOD
+%token <op> T_LT
+%token <op> T_GT
+%token <op> T_MOD
 %token T_DOT
 
 %token T_COMMENT
-%token <sval> T_INTCONSTANT
-%token <sval> T_CHARCONSTANT
-%token <sval> T_STRINGCONSTANT
-%token <sval> T_ID
+%token <sym> T_INTCONSTANT
+%token <sym> T_CHARCONSTANT
+%token <sym> T_STRINGCONSTANT
+%token <sym> T_ID
 %token T_WHITESPACE
 %token T_UNARYMINUS
 %token T_ERROR_1
@@ -110,7 +173,9 @@ x%token T_PACKAGE
 %type <ast> block assign method_call if_stmt while_stmt for_stmt return_stmt break_stmt continue_stmt
 %type <ast> expr value constant method_arg_list method_arg_comma_list method_arg assign_list optional_expr
 %type <deque_ptr> id_comma_list 
-%type <sval> extern_type decaf_type method_type bool_constant
+%type <type> extern_type decaf_type method_type
+%type <hint> method_attr
+%type <ival> bool_constant
 %type <arrinfo> array_type
 
 %%
@@ -125,16 +190,8 @@ program: extern_list decafpackage
          {
            cout << getString(prog) << endl;
          }
-         try 
-         {
-           prog->Codegen();
-         } 
-         catch (std::runtime_error &e)
-         {
-           cout << "semantic error: " << e.what() << endl;
-           exit(EXIT_FAILURE);
-         } 
-         delete prog;
+         // folded and generated by main once the parse is done
+         ctx->program = prog;
        }
        ;
 
@@ -157,33 +214,29 @@ extern_list: /* extern_list can be empty */ { $$ = NULL; }
 
 extern_def: T_EXTERN T_FUNC T_ID T_LPAREN extern_type_comma_list T_RPAREN method_type T_SEMICOLON
           {
-            ExternAST* e = new ExternAST(*$3, (decafStmtList*)$5, *$7);
+            ExternAST* e = new ExternAST($3, (decafStmtList*)$5, $7);
              $$ = e;
-             delete $3;
-             delete $7;
           }      
           ;
 
 extern_type_comma_list: extern_type T_COMMA extern_type_comma_list
                       {
                         decafStmtList* slist = (decafStmtList*)$3;
-                        VarDefAST* e = new VarDefAST(string(""), *$1, true);
+                        VarDefAST* e = new VarDefAST(symnames.intern(""), $1, true);
                         slist->push_front(e);
                         $$ = slist;
-                        delete $1;
                       } 
                       | extern_type
                       {
                         decafStmtList* slist = new decafStmtList();
-                        VarDefAST* e = new VarDefAST(string(""),*$1, true);
+                        VarDefAST* e = new VarDefAST(symnames.intern(""), $1, true);
                         slist->push_front(e);
                         $$ = slist;
-                        delete $1;     
 		      }
                       | /* Empty */
                       {
                         decafStmtList* slist = new decafStmtList();
-                        VarDefAST* e = new VarDefAST(string(""), string(""), true);
+                        VarDefAST* e = new VarDefAST(symnames.intern(""), TY_NONE, true);
                         slist->push_front(e);
                         $$ = slist;
 		      }
@@ -191,8 +244,7 @@ extern_type_comma_list: extern_type T_COMMA extern_type_comma_list
 
 decafpackage: T_PACKAGE T_ID begin_block field_decls method_decls end_block
             { 
-              $$ = new PackageAST(*$2, (decafStmtList*)$4, (decafStmtList*)$5 ); 
-              delete $2; 
+              $$ = new PackageAST(symnames.name($2), (decafStmtList*)$4, (decafStmtList*)$5 ); 
             }
             ;
 
@@ -222,12 +274,9 @@ field_decl: T_VAR id_comma_list decaf_type T_SEMICOLON
 
               for(int x = 0; x < $2->size(); ++x)
               {
-                e = new FieldAST((*$2)[x],*$3,"Scalar", false);
+                e = new FieldAST((*$2)[x], $3, "Scalar", 0, false);
                 slist->push_back(e);
               }    
-   
-              delete $2;
-              delete $3;
 
               $$ = slist; 
             } 
@@ -236,22 +285,21 @@ field_decl: T_VAR id_comma_list decaf_type T_SEMICOLON
             {
 
               decafStmtList* slist = new decafStmtList();
-              string FieldType;
+              decaf_type FieldType;
               string FieldSize; 
+              int ArraySize;
               FieldAST* e;
                
-              FieldType = *($3.type);
-              FieldSize = string("Array(") + *($3.size) + ")";
+              FieldType = $3.type;
+              FieldSize = string("Array(") + ctx->literals.name($3.size) + ")";
+              ArraySize = string_to_int(ctx->literals.name($3.size));
 
               for(int x = 0; x < $2->size(); ++x)
               {
-                e = new FieldAST((*$2)[x],FieldType, FieldSize, false);
+                e = new FieldAST((*$2)[x],FieldType, FieldSize, ArraySize, false);
                 slist->push_back(e);
               }    
 
-              delete $2;
-              delete $3.type;
-              delete $3.size;
               $$ = slist;
 	    }
 
@@ -266,30 +314,25 @@ field_decl: T_VAR id_comma_list decaf_type T_SEMICOLON
                 return 1;
 	      }              
              
-              e = new FieldAST((*$2)[0],*$3,$5,true);
+              e = new FieldAST((*$2)[0], $3, $5, true);
               slist->push_back(e);
-                   
-              delete $2;
-              delete $3;
-    
+
               $$ = slist; 
             }
             ;
 
 id_comma_list: T_ID T_COMMA id_comma_list 
              {
-               deque<string>* ilist;
+               id_list* ilist;
                ilist = $3;
-               ilist->push_front(*$1);
-               delete $1;
+               ilist->push_front($1);
                $$ = ilist;
              }
              | T_ID
              {
-               deque<string>* ilist;
-               ilist = new deque<string>;
-               ilist->push_front(*$1);
-               delete $1;
+               id_list* ilist;
+               ilist = new_id_list();
+               ilist->push_front($1);
                $$ = ilist;
              }
              ;
@@ -313,30 +356,51 @@ method_decls: /* Empty(zero or more) */
             }                     
             ;
 
-method_decl: T_FUNC T_ID T_LPAREN param_list T_RPAREN method_type block
+method_decl: method_attr T_FUNC T_ID T_LPAREN param_list T_RPAREN method_type block
             { 
               decafStmtList* slist = new decafStmtList();
               decafStmtList* q;
 
-              string MethodType; 
+              decaf_type MethodType; 
               MethodAST* e;
-              MethodType = *$6;
+              MethodType = $7;
               
-              ((BlockAST*)$7)->setMethodBlock(true);
+              ((BlockAST*)$8)->setMethodBlock(true);
                  
-              e = new MethodAST((*$2),MethodType,
-                                (decafStmtList*)$4, 
-                                (BlockAST*)$7);
+              e = new MethodAST($3,MethodType,
+                                (decafStmtList*)$5, 
+                                (BlockAST*)$8,
+                                $1);
 
               //slist->push_back(e);
               
                 
-              delete $2;  // free T_ID
-              delete $6;  // free method_type 
               // $$ = slist;
               $$ = (decafAST*)e;  
             } 
             ;
+/* inline and noinline are not reserved words, so existing programs can
+   keep using them as names; only before func are they attributes */
+method_attr: /* Empty */
+             { $$ = INLINE_DEFAULT; }
+           | T_ID
+             {
+               const string &attr = symnames.name($1);
+               if(attr == "inline")
+               {
+                 $$ = INLINE_ALWAYS;
+               }
+               else if(attr == "noinline")
+               {
+                 $$ = INLINE_NEVER;
+               }
+               else
+               {
+                 yyerror(ctx, ("unknown method attribute " + attr).c_str());
+                 YYABORT;
+               }
+             }
+           ;
 param_list: /* Empty(zero or more) */
              { $$ = NULL; }
              | id_type_comma_list 
@@ -345,24 +409,18 @@ param_list: /* Empty(zero or more) */
 id_type_comma_list: T_ID decaf_type T_COMMA id_type_comma_list
                   {
 		    VarDefAST* e;
-                    e = new VarDefAST(*$1,*$2, true);
+                    e = new VarDefAST($1, $2, true);
                     ((decafStmtList*)$4)->push_front(e);
  
                     $$ = $4;
-                    delete $1;
-                    delete $2;
                   }
                   | T_ID decaf_type
                   {
                     decafStmtList* slist = new decafStmtList();
                     VarDefAST* e;
-                    e = new VarDefAST(*$1, *$2, true);
+                    e = new VarDefAST($1, $2, true);
                     slist->push_front(e);
 
-
-
-                    delete $1; // free T_ID string 
-                    delete $2; // free decaf_type string 
                     $$ = slist;
                   }  
                   ;
@@ -377,13 +435,11 @@ block: begin_block var_decls statements end_block
 
 
 begin_block : T_LCB
-            { symtbl.push_front(symbol_table()); };
+            { symtbl.push_scope(); };
   
 end_block   : T_RCB
             {
-              symbol_table sym_table = symtbl.front();
-              free_element(sym_table);
-              symtbl.pop_front();          
+              symtbl.pop_scope();          
             };
 
 var_decls: /* Empty(zero or more) */
@@ -410,7 +466,7 @@ var_decl: T_VAR id_comma_list decaf_type T_SEMICOLON
           
           for(int x = 0; x < $2->size(); ++x)
 	  {  
-            e = new VarDefAST((*$2)[x], *$3, false);
+            e = new VarDefAST((*$2)[x], $3, false);
             slist->push_back(e);
 	  }
 
@@ -419,10 +475,32 @@ var_decl: T_VAR id_comma_list decaf_type T_SEMICOLON
             //print_descriptor((*$2)[x]);
           }  
         
-          delete $2;
-          delete $3;
           $$ = slist;
         }   
+        | T_VAR id_comma_list array_type T_SEMICOLON
+        {
+          decafStmtList* slist = new decafStmtList();
+          int ArraySize = string_to_int(ctx->literals.name($3.size));
+
+          if(ArraySize <= 0)
+          {
+            yyerror(ctx, "array size must be greater than 0");
+            YYABORT;
+          }
+          if(ArraySize > MAX_LOCAL_ARRAY_SIZE)
+          {
+            yyerror(ctx, ("local array size must be at most " + to_string(MAX_LOCAL_ARRAY_SIZE)).c_str());
+            YYABORT;
+          }
+
+          // method-local arrays, allocated in the stack frame
+          for(int x = 0; x < $2->size(); ++x)
+          {  
+            slist->push_back(new VarDefAST((*$2)[x], $3.type, ArraySize));
+          }
+
+          $$ = slist;
+        }
 ;
 
 statements: // Empty(zero or more)  
@@ -472,8 +550,7 @@ assign: value T_ASSIGN expr
 method_call: T_ID T_LPAREN method_arg_list T_RPAREN 
            {
              MethodCallAST* e;
-             $$ = new MethodCallAST(*$1, (decafStmtList*)$3);
-             delete $1;
+             $$ = new MethodCallAST($1, (decafStmtList*)$3);
            }  
            ;
 if_stmt: T_IF T_LPAREN expr T_RPAREN block 
@@ -492,7 +569,7 @@ while_stmt: T_WHILE T_LPAREN expr T_RPAREN block
           ;
 for_stmt: T_FOR T_LPAREN assign_list T_SEMICOLON expr T_SEMICOLON assign_list T_RPAREN block
         {   
-          $$ = new ForStmtAST((AssignAST*)$3,$5,(AssignAST*)$7, (BlockAST*)$9);
+          $$ = new ForStmtAST((decafStmtList*)$3,$5,(decafStmtList*)$7, (BlockAST*)$9);
         }  
         ; 
 
@@ -546,9 +623,8 @@ method_arg_comma_list: method_arg T_COMMA method_arg_comma_list
                ;
 method_arg: T_STRINGCONSTANT
           {
-            string str = yysval_to_string(*$1); 
-            $$ = new ConstantAST("StringType",str);           
-            delete $1;
+            string str = yysval_to_string(ctx->literals.name($1)); 
+            $$ = new ConstantAST(TY_STRING, str);           
           }
           | expr
           { $$ = $1; }   
@@ -567,151 +643,129 @@ expr: value
     }
     | expr T_PLUS expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_MINUS expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_MULT expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_DIV expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_LEFTSHIFT expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_RIGHTSHIFT expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_MOD expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_EQ expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_NEQ expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_LT expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_LEQ expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_GT expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_GEQ expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_AND expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }
     | expr T_OR expr
     {
-      BinaryExprAST* e = new BinaryExprAST(*$2, (decafStmtList*)$1, (decafStmtList*)$3);
+      BinaryExprAST* e = new BinaryExprAST($2, (decafStmtList*)$1, (decafStmtList*)$3);
       $$ = e;
-      delete $2;
     }   
     | T_LPAREN expr T_RPAREN  
     { $$ = $2; }
     | T_MINUS expr %prec T_UMINUS
     { 
-      UnaryExprAST* e = new UnaryExprAST(string("UnaryMinus"), (decafStmtList*)$2);
+      UnaryExprAST* e = new UnaryExprAST(OP_UNARYMINUS, (decafStmtList*)$2);
       $$ = e;
-      delete $1;
     }
     | T_NOT expr %prec T_UNOT
     { 
-      UnaryExprAST* e = new UnaryExprAST(*$1, (decafStmtList*)$2);
+      UnaryExprAST* e = new UnaryExprAST($1, (decafStmtList*)$2);
       $$ = e;
-      delete $1;
     }
     ;
 value: T_ID T_LSB expr T_RSB
      {        
-       ValueAST* e = new ValueAST(*$1, (decafStmtList*) $3);
-       delete $1;
+       ValueAST* e = new ValueAST($1, (decafStmtList*) $3);
        $$ = e;
      }
      | T_ID 
      { 
-       ValueAST* e = new ValueAST(*$1);
-       delete $1;
+       ValueAST* e = new ValueAST($1);
        $$ = e;
      }   
      ;
 
 constant: T_INTCONSTANT 
         {
-          $$ = new ConstantAST(string("IntType"), *$1);
-          delete $1;
+          $$ = new ConstantAST(TY_INT, ctx->literals.name($1));
         } 
         | T_CHARCONSTANT
         { 
-          $$ = new ConstantAST(string("IntType"), char_to_ascii_string(*$1));
-          delete $1;
+          $$ = new ConstantAST(TY_INT, char_to_ascii_string(ctx->literals.name($1)));
 	}
         | bool_constant
         {
-          $$ = new ConstantAST(string("BoolType"), *$1);
-	  delete $1;
+          $$ = new ConstantAST(TY_BOOL, $1);
         }
         ;
 bool_constant: T_TRUE 
-             { $$ = new string("True"); }
+             { $$ = 1; }
              | T_FALSE
-             { $$ = new string("False"); }
+             { $$ = 0; }
              ;
 decaf_type: T_INTTYPE
           {  
-            $$ = new string("IntType");
+            $$ = TY_INT;
           }     
           | T_BOOLTYPE
           {
-            $$ = new string("BoolType"); 
+            $$ = TY_BOOL; 
           }
           ;
 array_type: T_LSB T_INTCONSTANT T_RSB decaf_type
@@ -723,43 +777,791 @@ array_type: T_LSB T_INTCONSTANT T_RSB decaf_type
 }
 ;
 method_type: T_VOID
-           { $$ = new string("VoidType");}   
+           { $$ = TY_VOID; }   
            | decaf_type
            { $$ = $1; }
            ;
 extern_type: T_STRINGTYPE 
-           { $$ = new string("StringType");}
+           { $$ = TY_STRING; }
+           | T_LSB T_RSB T_INTTYPE
+           { $$ = TY_INTARRAY; }
            | decaf_type
            { $$ = $1;}
            ;
 %%  
 
-/* 
-   TODO: Need a way to keep track of all the pointers and free them 
-         when the parser encounters a syntax error    
-*/
-int main()
+// printTimeReport - write the --time-report to stderr in one piece, so
+// reports of concurrent batch jobs do not interleave
+void printTimeReport(const string &title)
 {
-  //cout<<"Main here"<<endl;
-  // initialize LLVM
-  llvm::LLVMContext &Context = llvm::getGlobalContext();
+  if(timeReportKind.empty()) { return; }
+
+  ostringstream out;
+  if(timeReportKind == "text")
+  {
+    if(!title.empty()) { out << "; " << title << endl; }
+    timeReport.print_text(out);
+  }
+  else
+  {
+    timeReport.print_json(out);
+  }
+  cerr << out.str() << flush;
+}
+
+// outputName - the output file: without -o textual IR goes to stderr as
+// before (""), everything else gets a file named after the package
+string outputName(const string &output, const string &package)
+{
+  if(!output.empty() || outputKind == "llvm") { return output; }
+  if(outputKind == "obj") { return package + ".o";  }
+  if(outputKind == "asm") { return package + ".s";  }
+  return package + ".bc";
+}
+
+// compileFile - compile one program, from stdin when input is empty, and
+// write it to output (IR on stderr when output is empty and the kind is
+// llvm) or run it with --run. The parse state is in a parse_context and
+// all other state it touches is per thread, so batch jobs call it
+// concurrently. Returns the exit status.
+int compileFile(const string &input, string output)
+{
+  int retval;
+  ProgramAST *prog;
+
+  timeReport = time_report();
+
+  // with a cache the source is read whole and looked up first; a hit
+  // skips everything from parsing to emission. Options with output of
+  // their own besides the compiled file are not cached.
+  bool caching = !cacheDir.empty() && !runProgram && !printAST && !inlineReport && !printOptTime;
+  string source, key;
+  if(caching)
+  {
+    if(!readSource(input, source))
+    {
+      cerr << "could not open " << input << endl;
+      return EXIT_FAILURE;
+    }
+
+    phase_clock cacheClock;
+    key = cacheKey(source);
+    string moduleId, bytes;
+    bool hit = cacheLoad(key, moduleId, bytes);
+    cacheClock.stop(timeReport.phase("cache"));
+
+    if(hit)
+    {
+      retval = 0;
+      try
+      {
+        writeOutput(outputName(output, moduleId), bytes);
+      }
+      catch (std::runtime_error &e)
+      {
+        cerr << "error: " << e.what() << endl;
+        retval = 1;
+      }
+      printTimeReport(input);
+      return(retval >= 1 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+  }
+
+  // a fresh context and builder for this file; the module and everything
+  // made from the context are gone before they are
+  llvm::LLVMContext Context;
+  llvm::IRBuilder<> FileBuilder(Context);
+  TheContext = &Context;
+  Builder = &FileBuilder;
 
   // make the module, which holds all the code.
-  TheModule = new llvm::Module("HW4", Context); 
+  TheModule = new llvm::Module("HW4", *TheContext); 
+
+  // lowering to native code needs the target before any pass runs
+  llvm::TargetMachine *TM = NULL;
+  bool nativeOutput = (outputKind == "obj" || outputKind == "asm");
+  if(nativeOutput || runProgram)
+  {
+    try
+    {
+      TM = createHostTargetMachine(optLevel, runProgram);
+    }
+    catch (std::runtime_error &e)
+    {
+      cerr << "error: " << e.what() << endl;
+      delete TheModule;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // set up the per function pass pipeline
+  if(promoteLocals)
+  {
+    TheFPM = new llvm::legacy::FunctionPassManager(TheModule);
+    TheFPM->add(llvm::createPromoteMemoryToRegisterPass());
+    // turn self recursion in tail position, including accumulator
+    // recursion like n * fact(n - 1), into a loop
+    TheFPM->add(llvm::createTailCallEliminationPass());
+    TheFPM->doInitialization();
+  }
 
   // set up symbol table
-  symtbl.push_front(symbol_table());
+  symtbl.push_scope();
 
   // parse the input and create the abstract syntax tree
-  int retval = yyparse();
+  FILE *in = stdin;
+  if(caching)
+  {
+    in = fmemopen((void *)source.data(), source.size(), "r");
+  }
+  else if(!input.empty())
+  {
+    in = fopen(input.c_str(), "r");
+  }
+  if(in == NULL)
+  {
+    cerr << "could not open " << input << endl;
+    retval = 1;
+  }
+  else
+  {
+    parse_context ctx;
+    phase_clock parseClock;
+    retval = parseProgram(ctx, in);
+    parseClock.stop(timeReport.phase("parse"));
+    timeReport.count("tokens", ctx.tokencount, "parse");
+    timeReport.count("ast nodes", astArena.count(), "parse");
+
+    prog = ctx.program;
+    if(in != stdin) { fclose(in); }
+  }
+
+  if(retval == 0 && foldConstants)
+  {
+    phase_clock foldClock;
+    fold_env env;
+    prog->Fold(env);
+    foldClock.stop(timeReport.phase("fold"));
+  }
+
+  if(retval == 0)
+  {
+    // verify+mem2reg runs per method inside codegen and is taken out of it
+    phase_time &codegen = timeReport.phase("codegen");
+    phase_time &verify  = timeReport.phase("verify+mem2reg");
+    phase_clock codegenClock;
+    try 
+    {
+      prog->Codegen();
+    } 
+    catch (std::runtime_error &e)
+    {
+      cerr << "semantic error: " << e.what() << endl;
+      retval = 1;
+    } 
+    codegenClock.stop(codegen);
+    codegen.wall -= verify.wall;
+    codegen.cpu  -= verify.cpu;
+    timeReport.count("ir instructions", countInstructions(TheModule), "codegen");
+  }
+
+  // a syntax or semantic error can leave block and loop scopes open, so
+  // the next file on this thread starts from an empty symbol table; the
+  // names go with the AST, which is no longer needed either way
+  symtbl.clear();
+  astArena.release();
+  symnames.clear();
+  trapBlocks.clear();
+  indexRanges.clear();
+
+  // run the optimization pipeline on a successfully generated module
+  if(retval == 0)
+  {
+    bool optError = false;
+    TheContext->setDiagnosticHandler(reportDiagnostic, &optError);
+    phase_time &optimize = timeReport.phase("optimize");
+    phase_clock optClock;
+    optimizeModule(optLevel);
+    optClock.stop(optimize);
+    TheContext->setDiagnosticHandler(NULL, NULL);
+    if(optError) { retval = 1; }
+    timeReport.count("optimized instructions", countInstructions(TheModule), "optimize");
+
+    // written as an IR comment so the output stays valid LLVM assembly
+    if(printOptTime)
+    {
+      cerr << "; -O" << optLevel << " optimization time: " << optimize.wall * 1e3 << " ms" << endl;
+    }
+  }
+
+  // the pass manager goes before the module it runs on
+  if(TheFPM != NULL) 
+  { 
+    delete TheFPM; 
+    TheFPM = NULL;
+  }
+
+  if(runProgram && retval == 0)
+  {
+    // the exit status of the run is the value returned by main; the
+    // JIT takes over both TM and the module
+    phase_clock runClock;
+    try
+    {
+      retval = runModule(TM);
+    }
+    catch (std::runtime_error &e)
+    {
+      cerr << "error: " << e.what() << endl;
+      return EXIT_FAILURE;
+    }
+    runClock.stop(timeReport.phase("jit+run"));
+    printTimeReport(input);
+    return retval;
+  }
+  else if(retval == 0)
+  {
+    output = outputName(output, TheModule->getModuleIdentifier());
+
+    phase_clock emitClock;
+    try
+    {
+      if(caching)
+      {
+        string bytes = emitBuffer(TM, outputKind);
+        writeOutput(output, bytes);
+        cacheStore(key, TheModule->getModuleIdentifier(), bytes);
+      }
+      else if(nativeOutput)
+      {
+        emitNativeFile(TM, output, outputKind == "asm");
+      }
+      else if(!output.empty())
+      {
+        emitModule(output, outputKind == "bc");
+      }
+      else
+      {
+        // Print out all of the generated code to stderr, buffered
+        llvm::raw_fd_ostream err(STDERR_FILENO, false);
+        TheModule->print(err, NULL);
+      }
+    }
+    catch (std::runtime_error &e)
+    {
+      cerr << "error: " << e.what() << endl;
+      retval = 1;
+    }
+    emitClock.stop(timeReport.phase("emit"));
+  }
+
+  printTimeReport(input);
 
-  // free the extern scope symtol table
-  symbol_table sym_table = symtbl.front();
-  //free_element(sym_table);
-  symtbl.pop_front();    
+  if(TM != NULL) { delete TM; }
 
-  // Print out all of the generated code to stderr
-  TheModule->dump();
+  delete TheModule;
+  TheModule = NULL;
     
   return(retval >= 1 ? EXIT_FAILURE : EXIT_SUCCESS);
 }
+
+// batchOutput - output file of a batch job: the input without its .decaf
+// suffix, plus the extension of the output kind
+string batchOutput(const string &input)
+{
+  string base = input;
+  if(base.size() > 6 && base.compare(base.size() - 6, 6, ".decaf") == 0)
+  {
+    base.erase(base.size() - 6);
+  }
+  if(outputKind == "obj") { return base + ".o";  }
+  if(outputKind == "asm") { return base + ".s";  }
+  if(outputKind == "bc")  { return base + ".bc"; }
+  return base + ".ll";
+}
+
+// compileBatch - compile every file on a pool of jobs threads; each file
+// gets its own LLVM context, module, builder and symbol table; the exit status
+// is a failure if any file failed
+int compileBatch(const vector<string> &inputs, unsigned int jobs)
+{
+  atomic<size_t> next(0);
+  atomic<int> failed(0);
+
+  if(jobs > inputs.size()) { jobs = inputs.size(); }
+
+  vector<thread> pool;
+  for(unsigned int t = 0; t < jobs; ++t)
+  {
+    pool.push_back(thread([&]()
+    {
+      for(size_t i = next++; i < inputs.size(); i = next++)
+      {
+        if(compileFile(inputs[i], batchOutput(inputs[i])) != EXIT_SUCCESS)
+        {
+          cerr << inputs[i] << ": compilation failed" << endl;
+          ++failed;
+        }
+      }
+    }));
+  }
+  for(size_t t = 0; t < pool.size(); ++t)
+  {
+    pool[t].join();
+  }
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// runCompiler - the compiler proper: parse the command line and compile
+// one file or a batch
+int runCompiler(int argc, char **argv)
+{
+  vector<string> inputFiles;
+  unsigned int jobs = thread::hardware_concurrency();
+
+  if(getenv("DECAFCOMP_CACHE") != NULL)
+  {
+    cacheDir = getenv("DECAFCOMP_CACHE");
+  }
+
+  //cout<<"Main here"<<endl;
+  // command line options
+  for(int i = 1; i < argc; ++i)
+  {
+    string arg = argv[i];
+    if(arg == "-no-mem2reg")
+    {
+      promoteLocals = false;
+    }
+    else if(arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3')
+    {
+      optLevel = arg[2] - '0';
+    }
+    else if(arg == "-fno-fold")
+    {
+      foldConstants = false;
+    }
+    else if(arg == "-fbounds-check")
+    {
+      boundsCheck = true;
+    }
+    else if(arg.compare(0, 19, "-finline-threshold=") == 0)
+    {
+      char *end;
+      long threshold = strtol(arg.c_str() + 19, &end, 10);
+      if(arg.size() == 19 || *end != '\0' || threshold < 0 || threshold > INT_MAX)
+      {
+        cerr << "invalid inline threshold: " << arg << endl;
+        return EXIT_FAILURE;
+      }
+      inlineThreshold = threshold;
+    }
+    else if(arg == "-inline-report")
+    {
+      inlineReport = true;
+    }
+    else if(arg == "--time-report")
+    {
+      timeReportKind = "text";
+    }
+    else if(arg == "--time-report=json")
+    {
+      timeReportKind = "json";
+    }
+    else if(arg == "-print-opt-time")
+    {
+      printOptTime = true;
+    }
+    else if(arg == "-c")
+    {
+      outputKind = "obj";
+    }
+    else if(arg == "-S")
+    {
+      outputKind = "asm";
+    }
+    else if(arg == "-emit-llvm")
+    {
+      outputKind = "llvm";
+    }
+    else if(arg == "-emit-bc")
+    {
+      outputKind = "bc";
+    }
+    else if(arg == "-o" && i + 1 < argc)
+    {
+      outputFile = argv[++i];
+    }
+    else if(arg == "--run")
+    {
+      runProgram = true;
+    }
+    else if(arg == "--cache")
+    {
+      // $XDG_CACHE_HOME/decafcomp, by default ~/.cache/decafcomp
+      const char *home = getenv("XDG_CACHE_HOME");
+      cacheDir = home != NULL ? string(home) : string(getenv("HOME") != NULL ? getenv("HOME") : ".") + "/.cache";
+      cacheDir += "/decafcomp";
+    }
+    else if(arg.compare(0, 8, "--cache=") == 0)
+    {
+      cacheDir = arg.substr(8);
+    }
+    else if(arg.compare(0, 13, "--cache-size=") == 0)
+    {
+      // a bad limit would empty the cache on every store
+      char *end;
+      unsigned long long mb = strtoull(arg.c_str() + 13, &end, 10);
+      if(arg.size() == 13 || *end != '\0' || !isdigit(arg[13]) || mb == 0 || mb > (ULLONG_MAX >> 20))
+      {
+        cerr << "invalid cache size: " << arg << endl;
+        return EXIT_FAILURE;
+      }
+      cacheLimit = mb << 20;
+    }
+    else if(arg == "-j" && i + 1 < argc)
+    {
+      jobs = atoi(argv[++i]);
+    }
+    else if(arg[0] != '-')
+    {
+      inputFiles.push_back(arg);
+    }
+    else
+    {
+      cerr << "unknown option: " << arg << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if(!inputFiles.empty()) { inputFile = inputFiles[0]; }
+
+  // the running program owns stdin, so --run reads the source from a file
+  if(runProgram && inputFile.empty())
+  {
+    cerr << "--run needs a source file" << endl;
+    return EXIT_FAILURE;
+  }
+
+  if(inputFiles.size() > 1 && (runProgram || !outputFile.empty()))
+  {
+    cerr << "--run and -o take a single source file" << endl;
+    return EXIT_FAILURE;
+  }
+
+  if(!cacheDir.empty() && llvm::sys::fs::create_directories(cacheDir))
+  {
+    cerr << "warning: cannot create cache directory " << cacheDir << ", not caching" << endl;
+    cacheDir = "";
+  }
+
+  // the native target is registered once for all jobs
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+
+  if(inputFiles.size() > 1)
+  {
+    return compileBatch(inputFiles, jobs > 0 ? jobs : 1);
+  }
+  return compileFile(inputFile, outputFile);
+}
+
+// Compile server (--server SOCKET, --connect SOCKET ...)
+//
+// A request is the 4 byte length of its body followed by the body, the
+// client's working directory and command line, each NUL terminated (so
+// empty arguments pass through), sent with the client's stdin, stdout and
+// stderr attached (SCM_RIGHTS). The server
+// forks a job per request, which starts from the server's initialized
+// LLVM and runtime bindings, runs the compiler on the client's files and
+// descriptors, and answers with the 4 byte exit status.
+
+// longest request body the server accepts
+static const uint32_t MAX_REQUEST = 1 << 20;
+
+// sendRequest - send the request and the descriptors fds[0..2]
+static bool sendRequest(int sock, const string &request, const int fds[3])
+{
+  struct iovec iov;
+  iov.iov_base = (void *)request.data();
+  iov.iov_len  = request.size();
+
+  char control[CMSG_SPACE(3 * sizeof(int))];
+  memset(control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN(3 * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+
+  ssize_t sent = sendmsg(sock, &msg, 0);
+  if(sent < 0) { return false; }
+
+  // the descriptors went with the first byte, the rest may follow
+  for(size_t pos = sent; pos < request.size(); pos += sent)
+  {
+    sent = write(sock, request.data() + pos, request.size() - pos);
+    if(sent <= 0) { return false; }
+  }
+  return true;
+}
+
+// receiveRequest - read a request into its strings and descriptors
+static bool receiveRequest(int sock, vector<string> &fields, int fds[3])
+{
+  char buf[4096];
+  struct iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len  = sizeof(buf);
+
+  char control[CMSG_SPACE(3 * sizeof(int))];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t got = recvmsg(sock, &msg, 0);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if(got <= 0 || cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+     cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+  {
+    return false;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+
+  // read on until the length and then the whole body are in
+  string data(buf, got);
+  uint32_t length;
+  while(data.size() < sizeof(length))
+  {
+    got = read(sock, buf, sizeof(buf));
+    if(got <= 0) { return false; }
+    data.append(buf, got);
+  }
+  memcpy(&length, data.data(), sizeof(length));
+  if(length > MAX_REQUEST) { return false; }
+
+  while(data.size() < sizeof(length) + length)
+  {
+    got = read(sock, buf, sizeof(buf));
+    if(got <= 0) { return false; }
+    data.append(buf, got);
+  }
+  if(data.size() != sizeof(length) + length) { return false; }
+
+  // split after each NUL
+  size_t start = sizeof(length);
+  for(size_t end = data.find('\0', start); end != string::npos; end = data.find('\0', start))
+  {
+    fields.push_back(data.substr(start, end - start));
+    start = end + 1;
+  }
+  return !fields.empty() && start == data.size();
+}
+
+// watchClient - end the whole job once the client has gone away, e.g. a
+// --connect killed by a timeout while its --run program loops; the client
+// sends nothing after the request, so readable means closed
+static void watchClient(int conn)
+{
+  struct pollfd pfd;
+  pfd.fd     = conn;
+  pfd.events = POLLIN;
+  char buf[64];
+  for(;;)
+  {
+    if(poll(&pfd, 1, -1) < 0)
+    {
+      if(errno == EINTR) { continue; }
+      return;
+    }
+    if((pfd.revents & (POLLHUP | POLLERR)) != 0 || recv(conn, buf, sizeof(buf), 0) <= 0)
+    {
+      kill(0, SIGKILL);
+    }
+  }
+}
+
+// serveRequest - one forked job: take over the client's directory and
+// descriptors, compile, and report the exit status; never returns
+static void serveRequest(int conn)
+{
+  vector<string> fields;
+  int fds[3];
+  if(!receiveRequest(conn, fields, fds)) { _exit(EXIT_FAILURE); }
+
+  // the job is a process group of its own, which the watchdog kills
+  setpgid(0, 0);
+  thread(watchClient, conn).detach();
+
+  for(int i = 0; i < 3; ++i)
+  {
+    dup2(fds[i], i);
+    close(fds[i]);
+  }
+
+  int32_t status = EXIT_FAILURE;
+  if(chdir(fields[0].c_str()) != 0)
+  {
+    cerr << "decafcomp server: cannot change to " << fields[0] << endl;
+  }
+  else
+  {
+    // fields[0] is the directory, its slot becomes argv[0]
+    fields[0] = "decafcomp";
+    vector<char *> args;
+    for(size_t i = 0; i < fields.size(); ++i)
+    {
+      args.push_back(&fields[i][0]);
+    }
+    args.push_back(NULL);
+    status = runCompiler(fields.size(), &args[0]);
+  }
+
+  cout << flush;
+  cerr << flush;
+  fflush(NULL);
+  if(write(conn, &status, sizeof(status)) != sizeof(status)) { _exit(EXIT_FAILURE); }
+  _exit(EXIT_SUCCESS);
+}
+
+// runServer - listen on the Unix socket path and fork a job per request
+int runServer(const string &path)
+{
+  // done once here, every job inherits it
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+  registerRuntime();
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(path.size() >= sizeof(addr.sun_path))
+  {
+    cerr << "socket path too long: " << path << endl;
+    return EXIT_FAILURE;
+  }
+  strcpy(addr.sun_path, path.c_str());
+
+  // only the socket of a server that is gone may be replaced, never a
+  // live server's socket or any other file
+  struct stat st;
+  if(lstat(path.c_str(), &st) == 0)
+  {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool alive = S_ISSOCK(st.st_mode) && probe >= 0 && 
+                 connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    if(probe >= 0) { close(probe); }
+    if(!S_ISSOCK(st.st_mode) || alive)
+    {
+      cerr << "cannot listen on " << path << ": address in use" << endl;
+      return EXIT_FAILURE;
+    }
+    unlink(path.c_str());
+  }
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, SOMAXCONN) != 0)
+  {
+    cerr << "cannot listen on " << path << ": " << strerror(errno) << endl;
+    return EXIT_FAILURE;
+  }
+
+  // finished jobs are reaped by the kernel
+  signal(SIGCHLD, SIG_IGN);
+  cerr << "decafcomp: serving on " << path << endl;
+
+  for(;;)
+  {
+    int conn = accept(sock, NULL, NULL);
+    if(conn < 0)
+    {
+      if(errno == EINTR) { continue; }
+      cerr << "accept: " << strerror(errno) << endl;
+      close(sock);
+      return EXIT_FAILURE;
+    }
+
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+      close(sock);
+      serveRequest(conn);
+    }
+    if(pid < 0)
+    {
+      cerr << "fork: " << strerror(errno) << endl;
+    }
+    close(conn);
+  }
+}
+
+// connectServer - send the command line to the server at path and return
+// the exit status of the job
+int connectServer(const string &path, int argc, char **argv)
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+  {
+    cerr << "cannot connect to " << path << ": " << strerror(errno) << endl;
+    return EXIT_FAILURE;
+  }
+
+  char cwd[PATH_MAX];
+  if(getcwd(cwd, sizeof(cwd)) == NULL)
+  {
+    cerr << "getcwd: " << strerror(errno) << endl;
+    return EXIT_FAILURE;
+  }
+
+  string body = string(cwd) + '\0';
+  for(int i = 0; i < argc; ++i)
+  {
+    body += string(argv[i]) + '\0';
+  }
+  uint32_t length = body.size();
+  string request = string((const char *)&length, sizeof(length)) + body;
+
+  int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+  int32_t status;
+  if(!sendRequest(sock, request, fds) || read(sock, &status, sizeof(status)) != sizeof(status))
+  {
+    // the job died, e.g. a --run program that hit a trap
+    cerr << "decafcomp: the compile server did not finish the request" << endl;
+    close(sock);
+    return EXIT_FAILURE;
+  }
+  close(sock);
+  return status;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc == 3 && string(argv[1]) == "--server")
+  {
+    return runServer(argv[2]);
+  }
+  if(argc >= 3 && string(argv[1]) == "--connect")
+  {
+    return connectServer(argv[2], argc - 3, argv + 3);
+  }
+  return runCompiler(argc, argv);
+}